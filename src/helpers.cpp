@@ -1,4 +1,5 @@
 #include "helpers.h"
+#include <render/textureLoader.h>
 #include <tinygltf-2.9.3/stb_image.h>
 
 void printVec(glm::vec3 v)
@@ -16,9 +17,25 @@ void printMat(glm::mat4 v)
 };
 
 
-GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels;
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
+ImageData DecodeTexture(const char *texture_file_path) {
+    ImageData image;
+
+    // Baked mip chains skip the decoding entirely
+    std::string bakedPath = bakedTexturePath(texture_file_path);
+    if (isBakeUpToDate(bakedPath.c_str(), texture_file_path) && loadBakedTexture(bakedPath.c_str(), image)) {
+        return image;
+    }
+
+    int channels;
+    image.pixels = stbi_load(texture_file_path, &image.width, &image.height, &channels, 3);
+
+    if (!image.pixels) {
+        std::cout << "Failed to load texture " << texture_file_path << std::endl;
+    }
+    return image;
+}
+
+GLuint UploadTexture(ImageData &image) {
     GLuint texture;
 
     // Generate an OpenGL texture and make use of it
@@ -28,18 +45,54 @@ GLuint LoadTextureTileBox(const char *texture_file_path) {
     // To tile textures on a box, we set wrapping to repeat
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    if (img) {
+    // RGB rows are not 4 bytes aligned for most widths
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (!image.levels.empty()) {
+        // Pre-built mip chain, BC1 is decoded here if the driver cannot sample it
+        bool compressed = image.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        bool supported = !compressed || hasGLExtension("GL_EXT_texture_compression_s3tc");
+
+        std::vector<uint8_t> decoded;
+        for (size_t i = 0; i < image.levels.size(); i++) {
+            const TextureLevel &level = image.levels[i];
+            if (compressed && supported) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, image.format, level.width, level.height, 0, level.size, level.data);
+            } else if (compressed) {
+                decodeBC1(level.data, level.width, level.height, decoded);
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, decoded.data());
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, level.data);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+    } else if (image.pixels) {
         // Load the image into the current OpenGL texture
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
         glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture " << texture_file_path << std::endl;
     }
-    stbi_image_free(img);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // The CPU copy is not needed anymore
+    FreeImageData(image);
 
     return texture;
 }
 
+void FreeImageData(ImageData &image) {
+    stbi_image_free(image.pixels);
+    image.pixels = NULL;
+
+    image.levels.clear();
+    delete image.file;
+    image.file = NULL;
+}
+
+GLuint LoadTextureTileBox(const char *texture_file_path) {
+    ImageData image = DecodeTexture(texture_file_path);
+    return UploadTexture(image);
+}
@@ -13,6 +13,7 @@
 #include <math.h>
 #include <iomanip>
 #include <render/shader.h>
+#include <render/mappedFile.h>
 
 //------------------------------------------------------------------//
 //																	//
@@ -22,8 +23,34 @@
 //																	//
 //------------------------------------------------------------------//
 
+// One level of a pre-built mip chain
+struct TextureLevel {
+    int width = 0;
+    int height = 0;
+    GLsizei size = 0;
+    const uint8_t *data = NULL;
+};
+
+// Decoded image waiting to be sent to the GPU
+struct ImageData {
+    int width = 0;
+    int height = 0;
+    uint8_t *pixels = NULL;     // RGB, NULL if decoding failed
+
+    // Baked textures, levels point in the mapped file instead of pixels
+    GLenum format = GL_RGB;     // GL_RGB or GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    std::vector<TextureLevel> levels;
+    MappedFile *file = NULL;
+};
+
 void printVec(glm::vec3 v);
 void printMat(glm::mat4 v);
+
+// Textures, decoding can be done on any thread, uploading needs the GL context
+// An up to date ".btex" next to the image is used instead of decoding it
+ImageData DecodeTexture(const char *texture_file_path);
+GLuint UploadTexture(ImageData &image);
+void FreeImageData(ImageData &image);
 GLuint LoadTextureTileBox(const char *texture_file_path);
 
 #endif //HELPERS_H
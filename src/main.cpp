@@ -35,6 +35,13 @@ int main(void)
         std::cerr << "Failed to initialize OpenGL context." << std::endl;
         return -1;
     }
+    loadGLExtensions(glfwGetProcAddress);
+
+    // Redundant binds are dropped from here on
+    installGLStateCache();
+
+    // Dynamic per frame data (poses, moved instances) goes through this ring
+    frameStream.init(streamRegionSize);
 
     // Prepare shadow map size for shadow mapping. Usually this is the size of the window itself, but on some platforms like Mac this can be 2x the size of the window. Use glfwGetFramebufferSize to get the shadow map size properly.
     glfwGetFramebufferSize(window, &depthMapWidth, &depthMapHeight);
@@ -45,33 +52,9 @@ int main(void)
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    // Create a frame buffer
-    glGenFramebuffers(1, &depthFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-
-    // Create Framebuffer Texture
-    glGenTextures(1, &depthTexture);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, depthMapWidth, depthMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
-
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    {
-        std::cerr << "Framebuffer is not complete." << std::endl;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Load shaders
-    shaders = LoadShaders();
+    // Create the frame buffers, the one of the frame and the cached static casters
+    createDepthTarget(depthFBO, depthTexture);
+    createDepthTarget(staticDepthFBO, staticDepthTexture);
 
     // Generate positions :
 
@@ -198,6 +181,22 @@ int main(void)
     gltfObj virgo,gemini,scorpio,virgo1,gemini1,scorpio1;
     gltfObj ships[6] = {virgo,gemini,scorpio,virgo1,gemini1,scorpio1};
 
+    // Every object goes in the scene BVH, culled per pass before anything is queued
+    SceneBVH sceneBVH;
+
+    // What the dome shell hides is left out through occlusion queries
+    OcclusionQueries occlusion;
+
+    // Or through the shell and the door rasterized on the CPU
+    SoftOcclusion softOcclusion;
+
+    // Everything that never moves nor animates is drawn by the batch
+    StaticBatch staticBatch;
+
+    // Billboards of the trees and ships once they are a few pixels large
+    Impostor oakImpostor, spruceImpostor;
+    Impostor shipImpostors[3];
+
     // Most complicated to setup (instancing) : Plants
     gltfObj grass2,grass3,grass41,grass42;
     gltfObj grass[4] = {grass2,grass3,grass41,grass42};
@@ -217,8 +216,12 @@ int main(void)
 
 // Initialise objects :
 
+    // Every file is read and decoded on the pool at once, the GL side is done once they are all ready
+    ThreadPool pool;
+    pool.init();
+
     // initializing objects
-    skybox.initialize(glm::vec3(boundary*0.6));
+    skybox.prepare(&pool);
 
     // Static Obj : Grass blocks
     // Grass elements
@@ -228,6 +231,7 @@ int main(void)
     for (int i = 0; i < 4; ++i)
     {
         grass[i].init_s();
+        grass[i].init_b(&staticBatch);
         grass[i].init_plmt(glm::vec3(0.0f,0.0f,0.0f),glm::vec3(0.5f * worldScale),glm::vec3(0.0f,1.0f,0.0f),0.0f);
     }
 
@@ -241,56 +245,136 @@ int main(void)
     for (int i = 0; i < 4; ++i)
     {
         std::string modelPath = "../assets/models/nature/" + names[i] + ".gltf";
-        grass[i].init(shaders["obj_si"],shaders["obj_dpth_i"],i,modelPath.c_str(), NULL);
+        grass[i].prepare(&pool, modelPath.c_str(), NULL);
     }
 
     oak.init_s();
+    oak.init_b(&staticBatch);
+    oak.init_imp(&oakImpostor);
     oak.init_plmt(glm::vec3(0.0f),glm::vec3(worldScale*2.5),glm::vec3(0.0f,1.0f,0.0f),0.0f);
     oak.init_i(3,oak_pos,oak_scl,oak_angl);
-    oak.init(shaders["obj_si"],shaders["obj_dpth_i"],5,"../assets/models/nature/oak.gltf", "../assets/textures/nature/trees.png");
+    oak.prepare(&pool, "../assets/models/nature/oak.gltf", "../assets/textures/nature/trees.png");
 
     spruce.init_s();
+    spruce.init_b(&staticBatch);
+    spruce.init_imp(&spruceImpostor);
     spruce.init_plmt(glm::vec3(0.0f),glm::vec3(worldScale*2.5),glm::vec3(0.0f,1.0f,0.0f),0.0f);
     spruce.init_i(2,spruce_pos,spruce_scl,spruce_angl);
-    spruce.init(shaders["obj_si"],shaders["obj_dpth_i"],6,"../assets/models/nature/spruce.gltf", "../assets/textures/nature/trees.png");
+    spruce.prepare(&pool, "../assets/models/nature/spruce.gltf", "../assets/textures/nature/trees.png");
 
     flowers.init_plmt(glm::vec3(-7.0f * 7.0f, 0.0f, -9.0f * 7.0f),glm::vec3(0.5f * worldScale),glm::vec3(0.0f,1.0f,0.0f),0.0f);
     flowers.init_s();
+    flowers.init_b(&staticBatch);
     flowers.init_i(flowerAmount,flowers_pos,flowers_scl,flowers_angl);
-    flowers.init(shaders["obj_si"],shaders["obj_dpth_i"],7,"../assets/models/nature/flower.gltf", "../assets/textures/nature/flowers.png");
+    flowers.prepare(&pool, "../assets/models/nature/flower.gltf", "../assets/textures/nature/flowers.png");
 
     flowers2.init_plmt(glm::vec3(2.0f * 7.0f, 0.0f, 9.0f*7.0f),glm::vec3(0.5f * worldScale),glm::vec3(0.0f,1.0f,0.0f),0.0f);
     flowers2.init_s();
+    flowers2.init_b(&staticBatch);
     flowers2.init_i(flowerAmount,flowers_pos,flowers_scl,flowers_angl);
-    flowers2.init(shaders["obj_si"],shaders["obj_dpth_i"],8,"../assets/models/nature/flower.gltf", "../assets/textures/nature/flowers.png");
+    flowers2.prepare(&pool, "../assets/models/nature/flower.gltf", "../assets/textures/nature/flowers.png");
 
     // Dome
     dome.init_s();
+    dome.init_b(&staticBatch);
     dome.init_plmt(glm::vec3(0.0f),glm::vec3(domeScale),glm::vec3(0.0f,1.0f,0.0f),0.0f);
-    dome.init(shaders["obj_s"],shaders["obj_dpth"],9,"../assets/models/dome/dome.gltf", NULL);
+    dome.init_occ(&softOcclusion);
+    dome.prepare(&pool, "../assets/models/dome/dome.gltf", NULL);
 
     // Doors
     door.init_plmt(glm::vec3(182.0f,0.0f,-12.5f),glm::vec3(25.0f,25.0f,50.0f),glm::vec3(0.0f,1.0f,0.0f),180.0f);
-    door.init(shaders["obj_nl"],shaders["obj_dpth"],20,"../assets/models/dome/door.gltf", "../assets/textures/dome/door.png");
+    door.init_occ(&softOcclusion);
+    door.prepare(&pool, "../assets/models/dome/door.gltf", "../assets/textures/dome/door.png");
 
     // Ships
-    prepShips(shaders,ships,10);
+    prepShips(ships, shipImpostors, &pool);
 
     gltfObj flame;
     flame.init_a();
     flame.init_plmt(glm::vec3(0.0f,-7.0f,228.0f),glm::vec3(3.5*worldScale),glm::vec3(0.0f,0.0f,1.0f),90.0f);
-    flame.init(shaders["obj_def"],shaders["obj_dpth"],17, "../assets/models/dome/flame.gltf", "../assets/textures/dome/flame.png");
+    flame.prepare(&pool, "../assets/models/dome/flame.gltf", "../assets/textures/dome/flame.png");
 
     gltfObj flame2;
     flame2.init_a();
     flame2.init_plmt(glm::vec3(0.0f,-7.0f,-220.0f),glm::vec3(3.5*worldScale),glm::vec3(0.0f,0.0f,1.0f),90.0f);
-    flame2.init(shaders["obj_def"],shaders["obj_dpth"],18, "../assets/models/dome/flame.gltf", "../assets/textures/dome/flame.png");
+    flame2.prepare(&pool, "../assets/models/dome/flame.gltf", "../assets/textures/dome/flame.png");
 
     // Create robot
     gltfObj robot;
     robot.init_a();
     robot.init_plmt(glm::vec3(126.0f,3.0f,-31.5f),glm::vec3(worldScale),glm::vec3(0.0f,1.0f,0.0f),-60.0f);
-    robot.init(shaders["obj_s"],shaders["obj_dpth"],19,"../assets/models/bot/botorobot.gltf", NULL);
+    robot.prepare(&pool, "../assets/models/bot/botorobot.gltf", NULL);
+
+    // Wait for the CPU side, then send everything to the GPU
+    pool.wait();
+
+    // The workers stay for the CPU occlusion bands
+    softOcclusion.init(&pool);
+
+    skybox.initialize(glm::vec3(boundary*0.6));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        grass[i].commit(obj_l | obj_s);
+    }
+    oak.commit(obj_l | obj_s);
+    spruce.commit(obj_l | obj_s);
+    flowers.commit(obj_l | obj_s);
+    flowers2.commit(obj_l | obj_s);
+    dome.commit(obj_l | obj_s);
+    door.commit(0);
+    commitShips(ships);
+    flame.commit(obj_l);
+    flame2.commit(obj_l);
+    robot.commit(obj_l | obj_s);
+
+    // Every member is committed, merge them
+    staticBatch.build();
+
+    // The views only need the GPU side of the models
+    oakImpostor.bake(lightPosition, lightIntensity);
+    spruceImpostor.bake(lightPosition, lightIntensity);
+    for (int i = 0; i < 3; ++i)
+    {
+        shipImpostors[i].bake(lightPosition, lightIntensity);
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        grass[i].insertBVH(&sceneBVH);
+    }
+    oak.insertBVH(&sceneBVH);
+    spruce.insertBVH(&sceneBVH);
+    flowers.insertBVH(&sceneBVH);
+    flowers2.insertBVH(&sceneBVH);
+    dome.insertBVH(&sceneBVH);
+    door.insertBVH(&sceneBVH);
+    for (int i = 0; i < 6; ++i)
+    {
+        ships[i].insertBVH(&sceneBVH);
+    }
+    flame.insertBVH(&sceneBVH);
+    flame2.insertBVH(&sceneBVH);
+    robot.insertBVH(&sceneBVH);
+
+    // The dome is the occluder, everything else is tested against it
+    occlusion.init();
+    for (int i = 0; i < 4; ++i)
+    {
+        grass[i].insertOcclusion(&occlusion);
+    }
+    oak.insertOcclusion(&occlusion);
+    spruce.insertOcclusion(&occlusion);
+    flowers.insertOcclusion(&occlusion);
+    flowers2.insertOcclusion(&occlusion);
+    door.insertOcclusion(&occlusion);
+    for (int i = 0; i < 6; ++i)
+    {
+        ships[i].insertOcclusion(&occlusion);
+    }
+    flame.insertOcclusion(&occlusion);
+    flame2.insertOcclusion(&occlusion);
+    robot.insertOcclusion(&occlusion);
 
 
 // The two different cameras
@@ -303,50 +387,39 @@ int main(void)
     glm::mat4 lightViewMatrix, lightProjectionMatrix;
     lightProjectionMatrix = glm::perspective(glm::radians(depthFoV), (float)depthMapWidth / depthMapHeight, depthNear, depthFar);
 
+    // What the static shadow map was drawn with, it is drawn again once either changes
+    bool staticShadowsCached = false;
+    glm::mat4 cachedLightMatrix;
+    float cachedShadowMod = 0.0f;
+
 // "Game" loop
     do
     {
-    // Managing the depth texture creation
-        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        lightViewMatrix = glm::lookAt(lightPosition,depthlookat,lightUp);
-        glm::mat4 lvp = lightProjectionMatrix * lightViewMatrix;
+        frameStream.beginFrame();
+        beginGLStateFrame();
 
-        dome.depthRender(lvp);
-        robot.depthRender(lvp);
-
-        flowers.depthRender(lvp);
-        flowers2.depthRender(lvp);
-
-        for (int i =0; i < 4; i++)
-        {
-            grass[i].depthRender(lvp);
-        }
-
-        oak.depthRender(lvp);
-        spruce.depthRender(lvp);
-
-        if (saveDepth) {
-            std::string filename = "depth_camera.png";
-            saveDepthTexture(depthFBO, filename);
-            std::cout << "Depth texture saved to " << filename << std::endl;
-            saveDepth = false;
-        }
-
-    // Rendering the scene
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Update states for animation
+    // Frame setup
         double currentTime = glfwGetTime();
         deltaTime = float(currentTime - lastTime);
         lastTime = currentTime;
 
-        // Rendering
+        lightViewMatrix = glm::lookAt(lightPosition,depthlookat,lightUp);
+        glm::mat4 lvp = lightProjectionMatrix * lightViewMatrix;
+
         viewMatrix = glm::lookAt(eye_center, lookat, up);
         glm::mat4 vp = projectionMatrix * viewMatrix;
 
+        FrameContext frameContext;
+        frameContext.cameraMatrix = vp;
+        frameContext.lightMatrix = lvp;
+        frameContext.eye = eye_center;
+        frameContext.lightPosition = lightPosition;
+        frameContext.lightIntensity = lightIntensity;
+        frameContext.depthTexture = depthTexture;
+        frameContext.lodScale = projectionMatrix[1][1] * windowHeight * 0.5f;
+        frameContext.depthPrepass = depthPrepass;
+        frameContext.staticShadowsDirty = !staticShadowsCached || lvp != cachedLightMatrix || domeSclMod != cachedShadowMod;
+
         // Change the mod values if we are far in space
         dome.init_plmt_mod(domeSclMod, domeSclMod);
         door.init_plmt_mod(domeSclMod, domeSclMod);
@@ -360,54 +433,134 @@ int main(void)
         flame2.init_plmt_mod(domeSclMod, domeSclMod);
         robot.init_plmt_mod(domeSclMod, domeSclMod);
 
-        // Classic render
-        dome.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+        // Move ships
+        moveShips(ships, 0.5f);
 
-        // We stop rendering the dome interior when the observer is far enough away to save performances as they cannot be seen anymore
-        if (domeSclMod >= 0.8f)
+        // Handling door opening/closing
+        if (glm::length(eye_center - glm::vec3(160.0f,20.0f,0.0f)) < 70.0f&& door.position.y > -30.0f)
         {
-            flowers.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
-            flowers2.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
-            for (int i =0; i < 4; i++){grass[i].render(vp,lightPosition,lightIntensity,lvp,depthTexture);}
+            door.position.y -= 0.1f;
+        }else
+        {
+            if (door.position.y < 0.0f)
+            {
+                door.position.y += 0.1f;
+            }
         }
-        if (domeSclMod >= 0.6f)
+
+    // Objects that moved are refit, then each pass keeps what its frustum touches
+        sceneBVH.beginFrame();
+        sceneBVH.refit();
+        sceneBVH.cull(passDepth, frustumFromMatrix(lvp));
+        sceneBVH.cull(passOpaque, frustumFromMatrix(vp));
+        occlusion.beginFrame(eye_center);
+
+        // The occluders moved with the objects, they are drawn before anything is tested
+        frameContext.softOcclusion = NULL;
+        if (softwareOcclusion)
         {
-            oak.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
-            spruce.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+            softOcclusion.render(vp);
+            frameContext.softOcclusion = &softOcclusion;
         }
 
-        // Render the flame
-        flame.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
-        flame2.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+    // Filling the queue, the order here does not matter anymore
+        renderQueue.clear();
+
+        // Shadow casters
+        dome.submit(renderQueue, passDepth, frameContext, depthFar);
+        robot.submit(renderQueue, passDepth, frameContext, depthFar);
+        flowers.submit(renderQueue, passDepth, frameContext, depthFar);
+        flowers2.submit(renderQueue, passDepth, frameContext, depthFar);
+        for (int i =0; i < 4; i++){grass[i].submit(renderQueue, passDepth, frameContext, depthFar);}
+        oak.submit(renderQueue, passDepth, frameContext, depthFar);
+        spruce.submit(renderQueue, passDepth, frameContext, depthFar);
+
+        // Classic render
+        dome.submit(renderQueue, passOpaque, frameContext, zFar);
+
+        // The dome interior is left out by its occlusion queries once the shell hides it
+        flowers.submit(renderQueue, passOpaque, frameContext, zFar);
+        flowers2.submit(renderQueue, passOpaque, frameContext, zFar);
+        for (int i =0; i < 4; i++){grass[i].submit(renderQueue, passOpaque, frameContext, zFar);}
+        oak.submit(renderQueue, passOpaque, frameContext, zFar);
+        spruce.submit(renderQueue, passOpaque, frameContext, zFar);
 
-        // Render the bot
-        robot.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+        flame.submit(renderQueue, passOpaque, frameContext, zFar);
+        flame2.submit(renderQueue, passOpaque, frameContext, zFar);
+        robot.submit(renderQueue, passOpaque, frameContext, zFar);
 
         // Placing the skybox
         skybox.position = skyboxPosOffset; // New pos = offset because skybox is initialized at (0,0,0)
-        skybox.render(vp, glm::vec3(skybox.scale*skyboxSclMod));
+        skybox.submit(renderQueue, glm::vec3(skybox.scale*skyboxSclMod), frameContext);
 
-        // Render and move ships
-        moveShips(ships, 0.5f);
-        for (int i =0; i < 6; i++)
+        for (int i =0; i < 6; i++){ships[i].submit(renderQueue, passOpaque, frameContext, zFar);}
+        door.submit(renderQueue, passOpaque, frameContext, zFar);
+
+        // The batch members only marked themselves, their draws are queued here
+        staticBatch.submit(renderQueue, frameContext, domeSclMod);
+
+        // Far instances were handed over by their objects and the batch
+        oakImpostor.submit(renderQueue, frameContext);
+        spruceImpostor.submit(renderQueue, frameContext);
+        for (int i = 0; i < 3; ++i){shipImpostors[i].submit(renderQueue, frameContext);}
+
+        renderQueue.sort();
+
+    // Managing the depth texture creation
+        // The batch only queued its casters if the light or its scale changed since they were cached
+        if (frameContext.staticShadowsDirty)
         {
-            ships[i].render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+            glBindFramebuffer(GL_FRAMEBUFFER, staticDepthFBO);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            renderQueue.execute(passStaticDepth, frameContext);
+
+            staticShadowsCached = true;
+            cachedLightMatrix = lvp;
+            cachedShadowMod = domeSclMod;
         }
 
-        // Handling door opening/closing
-        if (glm::length(eye_center - glm::vec3(160.0f,20.0f,0.0f)) < 70.0f&& door.position.y > -30.0f)
+        // The cached map is the base, only what moves or animates is drawn on top
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticDepthFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(0, 0, depthMapWidth, depthMapHeight, 0, 0, depthMapWidth, depthMapHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+
+        renderQueue.execute(passDepth, frameContext);
+
+        if (saveDepth) {
+            std::string filename = "depth_camera.png";
+            saveDepthTexture(depthFBO, filename);
+            std::cout << "Depth texture saved to " << filename << std::endl;
+            saveDepth = false;
+        }
+
+    // Rendering the scene
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Depth only first, every opaque draw then passes the test at its own depth only
+        if (depthPrepass)
         {
-            door.position.y -= 0.1f;
-        }else
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            renderQueue.execute(passPrepass, frameContext);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        renderQueue.execute(passOpaque, frameContext);
+
+        if (depthPrepass)
         {
-            if (door.position.y < 0.0f)
-            {
-                door.position.y += 0.1f;
-            }
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
         }
 
-        // Render the door
-        door.render(vp,lightPosition,lightIntensity,lvp,depthTexture);
+        // Boxes of what was queued, against the finished depth, read on the next frame
+        if (!softwareOcclusion)
+        {
+            occlusion.runQueries(vp);
+        }
 
         // Count number of frames over a few seconds and take average
         calcframerate();
@@ -420,6 +573,7 @@ int main(void)
         }
 
         // Swap buffers
+        frameStream.endFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
 
@@ -428,17 +582,28 @@ int main(void)
 
     // Clean up
     skybox.cleanup();
+    staticBatch.cleanup();
+    oakImpostor.cleanup();
+    spruceImpostor.cleanup();
+    for (int i=0; i < 3;i++){shipImpostors[i].cleanup();}
     dome.cleanup();
     flame.cleanup();
     flame2.cleanup();
     door.cleanup();
     flowers.cleanup();
+    flowers2.cleanup();
     robot.cleanup();
     oak.cleanup();
     spruce.cleanup();
 
     for (int i=0; i < 6;i++){ships[i].cleanup();}
     for (int i=0; i < 4;i++){grass[i].cleanup();}
+    sceneBVH.cleanup();
+    occlusion.cleanup();
+    softOcclusion.cleanup();
+    pool.cleanup();
+    frameStream.cleanup();
+    releasePrograms();
 
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
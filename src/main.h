@@ -10,6 +10,7 @@
 
 // GLTF model loader
 #define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_EXTERNAL_IMAGE
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <tiny_gltf.h>
@@ -24,11 +25,23 @@
 
 // Files import
 #include <render/shader.h>
+#include <render/shaderManager.h>
+#include <render/glExtensions.h>
+#include <render/streamBuffer.h>
+#include <render/renderQueue.h>
+#include <render/glState.h>
+#include <render/frustum.h>
+#include <render/sceneBVH.h>
+#include <render/occlusionQueries.h>
+#include <render/softOcclusion.h>
+#include <render/threadPool.h>
 #include "helpers.h"
 
 // Objects include
 #include "objects/skybox/skybox.h"
 #include "objects/obj/gltfObj.h"
+#include "objects/obj/staticBatch.h"
+#include "objects/obj/impostor.h"
 
 //---- Scaling to make things more simple to follow for me ----
 
@@ -77,11 +90,6 @@ static float FoV    = 60.0f;
 static float zNear  = 10.0f;
 static float zFar   = 3*boundary;
 
-//---- Shaders ----
-
-// Shaders dictionary
-std::map<std::string,GLuint> shaders;
-
 //---- Shadows ----
 
 // Lighting
@@ -91,6 +99,10 @@ static glm::vec3 lightIntensity(0.25e6f);
 GLuint depthFBO;
 GLuint depthTexture;
 
+// Shadow map of the static casters alone, the base depthFBO starts from every frame
+GLuint staticDepthFBO;
+GLuint staticDepthTexture;
+
 // Shadow mapping
 static int depthMapWidth = 1024;
 static int depthMapHeight = 758;
@@ -116,36 +128,27 @@ float thetime = 0.0f;			            // Animation time
 float fTime = 0.0f;			                // Time for measuring fps
 unsigned long frames = 0;
 
+//---- Render queue ----
+
+// Every draw of the frame, sorted before submission
+RenderQueue renderQueue;
+
+//---- Streaming ----
+
+// Bytes of dynamic data per frame, bigger uploads fall back to glBufferSubData
+static GLsizeiptr streamRegionSize = 1 << 20;
+
 //---- Debug ----
 
 bool saveDepth = false;
 
-//---- Methods ----
-
-std::map<std::string,GLuint> LoadShaders()
-{
-    std::map<std::string,GLuint> shaderlist;
+// O switches the occlusion culling between the GPU queries and the CPU rasterizer
+bool softwareOcclusion = false;
 
-    GLuint nolightID = LoadShadersFromFile("../src/shaders/obj/obj_nl.vert", "../src/shaders/obj/obj_nl.frag");
-    GLuint programID = LoadShadersFromFile("../src/shaders/obj/obj_def.vert", "../src/shaders/obj/obj_def.frag");
-    GLuint depthProgramID = LoadShadersFromFile("../src/shaders/obj/obj_dpth.vert", "../src/shaders/obj/obj_dpth.frag");
-    GLuint shadowProgramID = LoadShadersFromFile("../src/shaders/obj/obj_s.vert", "../src/shaders/obj/obj_s.frag");
-    GLuint instancedshadowProgramID = LoadShadersFromFile("../src/shaders/obj/obj_si.vert", "../src/shaders/obj/obj_s.frag");
-    GLuint depthProgramID_i = LoadShadersFromFile("../src/shaders/obj/obj_dpth_i.vert", "../src/shaders/obj/obj_dpth.frag");
+// P lays the depth down first, the color pass then only shades the closest fragments (GL_EQUAL)
+bool depthPrepass = false;
 
-    if (programID == 0 || depthProgramID == 0 || shadowProgramID == 0 || instancedshadowProgramID == 0 || depthProgramID_i == 0 || nolightID == 0)
-    {
-        std::cerr << "Failed to load shaders." << std::endl;
-    }
-    shaderlist["obj_def"] = programID;
-    shaderlist["obj_dpth"] = depthProgramID;
-    shaderlist["obj_s"] = shadowProgramID;
-    shaderlist["obj_si"] = instancedshadowProgramID;
-    shaderlist["obj_dpth_i"] = depthProgramID_i;
-    shaderlist["obj_nl"] = nolightID;
-
-    return shaderlist;
-}
+//---- Methods ----
 
 //---
 // Midpoint algorithm viewed from : https://www.youtube.com/watch?v=hpiILbMkF9w
@@ -194,29 +197,31 @@ std::vector<glm::vec3> calcDomeGrid(int pixelSize, int cx, int cy)
 
 //---
 
-void prepShips(std::map<std::string,GLuint> shaders, gltfObj ships[6],int blockBindFloor)
+// CPU side of the ships loading, commitShips must be called once the pool is done
+// Ships sharing a model share its impostor
+void prepShips(gltfObj ships[6], Impostor impostors[3], ThreadPool *pool)
 {
     std::string names[3] = {"virgo","scorpio","gemini"};
     float scales[3] = {2*8.0f,2*6.0f,2*5.0f};
     float rot[3] = {-90.0f,-90.0f,-90.0f};
 
-    for (int i = 0; i < 3; ++i)
+    for (int i = 0; i < 6; ++i)
     {
-        std::string modelPath = "../assets/models/ships/" + names[i] + ".gltf";
-        std::string texturePath = "../assets/textures/ships/" + names[i] + ".png";
+        std::string modelPath = "../assets/models/ships/" + names[i%3] + ".gltf";
+        std::string texturePath = "../assets/textures/ships/" + names[i%3] + ".png";
 
         ships[i].init_s();
-        ships[i].init_plmt(glm::vec3(-2*boundary,0.0f,0.0f),glm::vec3(worldScale*scales[i]),glm::vec3(0.0f,1.0f,0.0f),rot[i]);
-        ships[i].init(shaders["obj_def"],shaders["obj_dpth"],i + blockBindFloor,modelPath.c_str(), texturePath.c_str());
+        ships[i].init_imp(&impostors[i%3]);
+        ships[i].init_plmt(glm::vec3(-2*boundary,0.0f,0.0f),glm::vec3(worldScale*scales[i%3]),glm::vec3(0.0f,1.0f,0.0f),rot[i%3]);
+        ships[i].prepare(pool, modelPath.c_str(), texturePath.c_str());
     }
-    for (int i = 3; i < 6; ++i)
-    {
-        std::string modelPath = "../assets/models/ships/" + names[i-3] + ".gltf";
-        std::string texturePath = "../assets/textures/ships/" + names[i-3] + ".png";
+}
 
-        ships[i].init_s();
-        ships[i].init_plmt(glm::vec3(-2*boundary,0.0f,0.0f),glm::vec3(worldScale*scales[i-3]),glm::vec3(0.0f,1.0f,0.0f),rot[i-3]);
-        ships[i].init(shaders["obj_def"],shaders["obj_dpth"],i + blockBindFloor,modelPath.c_str(), texturePath.c_str());
+void commitShips(gltfObj ships[6])
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        ships[i].commit(obj_l);
     }
 }
 
@@ -290,6 +295,33 @@ void moveShips(gltfObj ships[6], float currentStep)
 
 //---- Back to unrelated methods ----
 
+// Depth only frame buffer of the shadow map size, its texture is read by the shaders
+static void createDepthTarget(GLuint &fbo, GLuint &texture) {
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    // Create Framebuffer Texture
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, depthMapWidth, depthMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Framebuffer is not complete." << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 static void saveDepthTexture(GLuint fbo, std::string filename) {
     int width = depthMapWidth;
     int height = depthMapHeight;
@@ -327,8 +359,15 @@ void calcframerate()
         frames = 0;
         fTime = 0;
 
+        // State changes of the last frame, sorted against the submission order
         std::stringstream stream;
-        stream << std::fixed << std::setprecision(2) << "Final Project | Frames per second (FPS): " << fps;
+        stream << std::fixed << std::setprecision(2) << "Final Project | Frames per second (FPS): " << fps
+               << " | Draws: " << renderQueue.drawCount
+               << " | State changes: " << renderQueue.sortedChanges.total()
+               << " (unsorted " << renderQueue.unsortedChanges.total() << ")"
+               << " | Binds: " << glStateLastFrame().issued << " issued, " << glStateLastFrame().filtered << " filtered"
+               << " | Occlusion: " << (softwareOcclusion ? "CPU" : "GPU")
+               << " | Pre-pass: " << (depthPrepass ? "on" : "off");
         glfwSetWindowTitle(window, stream.str().c_str());
     }
 };
@@ -472,6 +511,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             }
         }
 
+        if (key == GLFW_KEY_O && action == GLFW_PRESS)
+        {
+            softwareOcclusion = !softwareOcclusion;
+        }
+        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        {
+            depthPrepass = !depthPrepass;
+        }
+
         // Handling view movement
         if (key == GLFW_KEY_UP)
         {
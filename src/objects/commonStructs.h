@@ -1,8 +1,12 @@
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <map>
+#include <string>
 #include <vector>
 
+#include <render/mappedFile.h>
+
 //------------------------------------------------------------------//
 //																	//
 //		This file contain a list of all the common structure        //
@@ -24,15 +28,35 @@ struct MaterialObject
     GLfloat RoughnessFactor;
 };
 
-// Each VAO corresponds to each mesh primitive in the GLTF model
+// Levels of detail of a primitive, level 0 is the full mesh
+const int maxLods = 4;
+
+// Level past the coarsest mesh, drawn by the Impostor of the object if it has one (the coarsest mesh otherwise)
+const GLuint impostorLod = maxLods;
+
+// Each primitive is a range of the model's shared vertex and index buffers
 struct PrimitiveObject {
-    GLuint vao;
-    std::map<int, GLuint> vbos;
     MaterialObject material;
+
+    // Draw call
+    int mesh;
+    GLenum mode;
+    GLsizei indexCount;
+    GLenum indexType;
+    GLuint indexOffset;                 // In bytes
+    GLint baseVertex;
+
+    // Coarser index ranges, same vertices, level 0 is indexCount / indexOffset
+    GLuint lodCount;
+    GLsizei lodIndexCount[maxLods];
+    GLuint lodIndexOffset[maxLods];     // In bytes
 };
 
 // Skinning
 struct SkinObject {
+    // Nodes used as joints
+    std::vector<int> joints;
+
     // Transforms the geometry into the space of the respective joint
     std::vector<glm::mat4> inverseBindMatrices;
 
@@ -56,6 +80,71 @@ struct ChannelObject {
 };
 struct AnimationObject {
     std::vector<SamplerObject> samplers;	// Animation data
+    std::vector<ChannelObject> channels;	// Which node each sampler moves
+};
+
+//---- Model data, what is left of a GLTF file once it has been loaded ----
+
+// Interleaved vertex, every model is repacked to this layout when loaded
+struct Vertex {
+    glm::vec3 position;                 // location 0
+    glm::vec3 normal;                   // location 1
+    glm::vec2 uv;                       // location 2
+    GLushort joints[4];                 // location 3
+    glm::vec4 weights;                  // location 4
+};
+static_assert(sizeof(Vertex) == 56, "Vertex must stay tightly packed, the baked files depend on it");
+
+// Range of the model buffers drawn with one call
+struct PrimitiveData {
+    GLenum mode;
+    GLint material;
+    GLuint indexCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint vertexCount;
+
+    // Simplified index ranges after the full one, level 0 is firstIndex / indexCount
+    GLuint lodCount;
+    GLuint lodFirstIndex[maxLods];
+    GLuint lodIndexCount[maxLods];
+};
+
+struct MeshData {
+    std::vector<PrimitiveData> primitives;
+};
+
+struct NodeData {
+    glm::mat4 transform;                // Local transform
+    int mesh;
+    std::vector<int> children;
+};
+
+// Everything a gltfObj needs, without the GLTF DOM
+struct ModelData {
+    // One vertex and one index buffer for the whole model
+    const Vertex *vertices = NULL;
+    GLuint vertexCount = 0;
+    const unsigned char *indices = NULL;
+    GLuint indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;   // GL_UNSIGNED_INT if a primitive has more than 65536 vertices
+
+    // Model space box around every POSITION accessor, what the culling spheres are made from
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    std::vector<MeshData> meshes;
+    std::vector<NodeData> nodes;
+    std::vector<int> sceneNodes;        // Roots of the default scene
+
+    std::vector<MaterialObject> materials;
+    std::vector<SkinObject> skins;      // In bind pose
+    std::vector<AnimationObject> animations;
+
+    // Memory behind vertices and indices, either repacked from the GLTF or a baked file
+    std::vector<Vertex> vertexStorage;
+    std::vector<unsigned char> indexStorage;
+    MappedFile mapping;
 };
 
 #endif //COMMONSTRUCTS_H
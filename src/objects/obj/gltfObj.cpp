@@ -1,5 +1,16 @@
-#include <tiny_gltf.h>
 #include "gltfObj.h"
+#include "modelLoader.h"
+#include "staticBatch.h"
+#include "impostor.h"
+
+#include <render/shaderManager.h>
+#include <render/streamBuffer.h>
+#include <render/renderQueue.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstddef>
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
@@ -9,432 +20,358 @@ gltfObj::~gltfObj() {
 	cleanup();
 }
 
-// Get node transforms from node
-glm::mat4 gltfObj::getNodeTransform(const tinygltf::Node& node) {
-	glm::mat4 transform(1.0f);
-
-	if (node.matrix.size() == 16) {
-		transform = glm::make_mat4(node.matrix.data());
-	} else {
-		if (node.translation.size() == 3) {
-			transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
-		}
-		if (node.rotation.size() == 4) {
-			glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-			transform *= glm::mat4_cast(q);
-		}
-		if (node.scale.size() == 3) {
-			transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
-		}
-	}
-	return transform;
+// Vertex layout of the model buffers, recorded in the currently bound vao
+void gltfObj::bindVertexAttributes(ModelAsset *asset) {
+	glBindBuffer(GL_ARRAY_BUFFER, asset->vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, asset->indexBuffer);
+
+	// Interleaved layout, see Vertex
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, position)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, normal)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, uv)));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, joints)));
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, weights)));
 }
 
-// Compute local transforms and fill it with the node transforms
-void gltfObj::computeLocalNodeTransform(const tinygltf::Model& model,
-	int nodeIndex,
-	std::vector<glm::mat4> &localTransforms)
-{
-	const tinygltf::Node &node = model.nodes[nodeIndex];
-	localTransforms[nodeIndex] = getNodeTransform(node);
+// Instanced objects get one vao per pass and level, the shared buffers plus their block of instance matrices, so drawing only binds it
+void gltfObj::bindInstanceAttributes() {
+	glGenVertexArrays((passOpaque + 1) * maxLods, &instanceVAOs[0][0]);
 
-	for (const int childIndex : node.children)
+	for (int pass = 0; pass <= passOpaque; pass++)
 	{
-		computeLocalNodeTransform(model, childIndex,localTransforms);
-	};
-}
-
-// Compute global transforms and fill it with the node transforms
-void gltfObj::computeGlobalNodeTransform(const tinygltf::Model& model,
-	const std::vector<glm::mat4> &localTransforms,
-	int nodeIndex, const glm::mat4& parentTransform,
-	std::vector<glm::mat4> &globalTransforms)
-{
-	globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
-
-	for (const int childIndex : model.nodes[nodeIndex].children) {
-		computeGlobalNodeTransform(model, localTransforms, childIndex,globalTransforms[nodeIndex],globalTransforms);
-	};
-}
-
-// Create the skinObject vector and fill it with the created skin objects
-std::vector<SkinObject> gltfObj::prepareSkinning(const tinygltf::Model &model) {
-	std::vector<SkinObject> skinObjects;
-
-	// In our Blender exporter, the default number of joints that may influence a vertex is set to 4, just for convenient implementation in shaders.
-
-	for (size_t i = 0; i < model.skins.size(); i++) {
-		SkinObject skinObject;
-
-		const tinygltf::Skin &skin = model.skins[i];
-
-		// Read inverseBindMatrices
-		const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
-		assert(accessor.type == TINYGLTF_TYPE_MAT4);
-		const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-		const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-		const float *ptr = reinterpret_cast<const float *>(
-            buffer.data.data() + accessor.byteOffset + bufferView.byteOffset);
-
-		skinObject.inverseBindMatrices.resize(accessor.count);
-		for (size_t j = 0; j < accessor.count; j++) {
-			float m[16];
-			memcpy(m, ptr + j * 16, 16 * sizeof(float));
-			skinObject.inverseBindMatrices[j] = glm::make_mat4(m);
-		}
-
-		assert(skin.joints.size() == accessor.count);
-
-		skinObject.globalJointTransforms.resize(skin.joints.size());
-		skinObject.jointMatrices.resize(skin.joints.size());
-
-		// Compute joint matrices
-
-		// Get the root node
-		int rootNodeIndex = skin.joints[0];
-
-		// Compute the local node transforms
-		std::vector<glm::mat4> localNodeTransforms(skin.joints.size());
-		computeLocalNodeTransform(model, rootNodeIndex, localNodeTransforms);
-
-		// Compute the global node transforms
-		computeGlobalNodeTransform(model, localNodeTransforms, rootNodeIndex,glm::mat4(1.0f),
-			skinObject.globalJointTransforms);
-
-		// Calculate the joint matrices
-		for (size_t h = 0; h < skinObject.jointMatrices.size(); h++)
+		for (int level = 0; level < maxLods; level++)
 		{
-			int nodeIndex = skin.joints[h];
-			skinObject.jointMatrices[h] = skinObject.globalJointTransforms[nodeIndex] * skinObject.inverseBindMatrices[h];
-		}
+			glBindVertexArray(instanceVAOs[pass][level]);
+			bindVertexAttributes(modelAsset);
 
-		skinObjects.push_back(skinObject);
-	}
-	return skinObjects;
-}
-
-// Load the model
-bool gltfObj::loadModel(tinygltf::Model &model, const char *filename) {
-	tinygltf::TinyGLTF loader;
-	std::string err;
-	std::string warn;
-
-	bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-	if (!warn.empty()) {
-		std::cout << "WARN: " << warn << std::endl;
-	}
+			// We use 4 indexes because the maximum amount of possible data per index is 4 (vec4), it will still be received as mat4 in 5
+			std::size_t rowSize = sizeof(glm::vec4);
+			GLintptr block = instanceBlockOffset((RenderPass)pass, level);
+			glBindBuffer(GL_ARRAY_BUFFER, i_modelMatBuffer);
+			for (int i = 0; i < 4; i++)
+			{
+				glEnableVertexAttribArray(5 + i);
+				glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, BUFFER_OFFSET(block + i * rowSize));
 
-	if (!err.empty()) {
-		std::cout << "ERR: " << err << std::endl;
+				// This tells us that each matrix will be used for each instance
+				glVertexAttribDivisor(5 + i, 1);
+			}
+		}
 	}
 
-	if (!res)
-		std::cout << "Failed to load glTF: " << filename << std::endl;
-	else
-		std::cout << "Loaded glTF: " << filename << std::endl;
-
-	return res;
+	glBindVertexArray(0);
 }
 
-// Get material from model and push it to the materialObjects vector
-std::vector<MaterialObject> gltfObj::bindMaterials(tinygltf::Model &model)
+// Where the visible instances of a pass at a level are kept, room for all of them
+GLintptr gltfObj::instanceBlockOffset(RenderPass pass, GLuint level) const
 {
-	std::vector<MaterialObject> materialObjects;
-	for (size_t i=0; i< model.materials.size();i++)
-	{
-		const tinygltf::Material &fetchedmaterial = model.materials[i];
-		MaterialObject material;
-		material.BaseColorFactor = glm::vec4(1.0f);
-		// Fixed to 4 as it is RGBa
-		for (size_t j =0; j < 4; j++)
-		{
-			material.BaseColorFactor[j] = fetchedmaterial.pbrMetallicRoughness.baseColorFactor[j];
-		}
-		material.MetallicFactor = fetchedmaterial.pbrMetallicRoughness.metallicFactor;
-		material.RoughnessFactor = fetchedmaterial.pbrMetallicRoughness.roughnessFactor;
-
-		materialObjects.push_back(material);
-	}
-	return materialObjects;
-};
-
-// Generate vbos and vaas according to the model
-void gltfObj::bindMesh(std::vector<PrimitiveObject> &primitiveObjects,
-			tinygltf::Model &model, tinygltf::Mesh &mesh) {
-
-	std::map<int, GLuint> vbos;
-	for (size_t i = 0; i < model.bufferViews.size(); ++i) {
-		const tinygltf::BufferView &bufferView = model.bufferViews[i];
-
-		int target = bufferView.target;
+	return (GLintptr)(pass * maxLods + level) * instanced * sizeof(glm::mat4);
+}
 
-		if (bufferView.target == 0) {
-			// The bufferView with target == 0 in our model refers to
-			// the skinning weights, for 25 joints, each 4x4 matrix (16 floats), totaling to 400 floats or 1600 bytes.
-			// So it is considered safe to skip the warning.
-			//std::cout << "WARN: bufferView.target is zero" << std::endl;
-			continue;
-		}
+// Upload the model's vertex and index buffers once, every primitive is a range of them
+std::vector<PrimitiveObject> gltfObj::bindModel(ModelAsset *asset) {
+	const ModelData &data = asset->data;
+	std::vector<PrimitiveObject> primitiveObjects;
 
-		const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		glBindBuffer(target, vbo);
-		glBufferData(target, bufferView.byteLength,
-					&buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
+	glGenVertexArrays(1, &asset->vao);
+	glBindVertexArray(asset->vao);
 
-		vbos[i] = vbo;
-	}
+	glGenBuffers(1, &asset->vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, asset->vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.vertexCount * sizeof(Vertex), data.vertices, GL_STATIC_DRAW);
 
-	// Each mesh can contain several primitives (or parts), each we need to
-	// bind to an OpenGL vertex array object
-	for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+	// The element buffer is part of the vao state
+	size_t indexSize = (data.indexType == GL_UNSIGNED_INT) ? sizeof(GLuint) : sizeof(GLushort);
+	glGenBuffers(1, &asset->indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, asset->indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexCount * indexSize, data.indices, GL_STATIC_DRAW);
 
-		tinygltf::Primitive primitive = mesh.primitives[i];
-		tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+	bindVertexAttributes(asset);
 
-		GLuint vao;
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
+	glBindVertexArray(0);
 
-		for (auto &attrib : primitive.attributes) {
-			tinygltf::Accessor accessor = model.accessors[attrib.second];
-			int byteStride =
-				accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-			glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
+	for (size_t m = 0; m < data.meshes.size(); ++m) {
+		for (size_t i = 0; i < data.meshes[m].primitives.size(); ++i) {
+			const PrimitiveData &primitive = data.meshes[m].primitives[i];
 
-			int size = 1;
-			if (accessor.type != TINYGLTF_TYPE_SCALAR) {
-				size = accessor.type;
-			}
+			PrimitiveObject primitiveObject;
 
-			int vaa = -1;
-			if (attrib.first.compare("POSITION") == 0) vaa = 0;
-			if (attrib.first.compare("NORMAL") == 0) vaa = 1;
-			if (attrib.first.compare("TEXCOORD_0") == 0) vaa = 2;
-			if (attrib.first.compare("JOINTS_0") == 0) vaa = 3;
-			if (attrib.first.compare("WEIGHTS_0") == 0) vaa = 4;
-			if (vaa > -1) {
-				glEnableVertexAttribArray(vaa);
-				glVertexAttribPointer(vaa, size, accessor.componentType,
-									accessor.normalized ? GL_TRUE : GL_FALSE,
-									byteStride, BUFFER_OFFSET(accessor.byteOffset));
+			// Fetch current material and store it in primitive object, primitives without one get the GLTF default
+			if (primitive.material >= 0 && primitive.material < (GLint)data.materials.size()) {
+				primitiveObject.material = data.materials[primitive.material];
 			} else {
-				std::cout << "vaa missing: " << attrib.first << std::endl;
+				primitiveObject.material.BaseColorFactor = glm::vec4(1.0f);
+				primitiveObject.material.MetallicFactor = 1.0f;
+				primitiveObject.material.RoughnessFactor = 1.0f;
 			}
-		}
 
-		// Record VAO for later use
-		PrimitiveObject primitiveObject;
-		primitiveObject.vao = vao;
-		primitiveObject.vbos = vbos;
-
-		// Fetch current material
-		MaterialObject material = materialObjects[primitive.material];
-
-		// Update for first render
-		glUniform4fv(materialUniID, 1, &material.BaseColorFactor[0]);
-		glUniform1fv(metallicUniID, 1, &material.MetallicFactor);
-		glUniform1fv(roughnessUniID, 1, &material.RoughnessFactor);
-
-		// Store material in primitive object
-		primitiveObject.material = material;
-
-		// Store in the general vector
-		primitiveObjects.push_back(primitiveObject);
-
-		glBindVertexArray(0);
-	}
-}
-
-// Bind mesh of every node
-void gltfObj::bindModelNodes(std::vector<PrimitiveObject> &primitiveObjects,
-					tinygltf::Model &model,
-					tinygltf::Node &node) {
-	// Bind buffers for the current mesh at the node
-	if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-		bindMesh(primitiveObjects, model, model.meshes[node.mesh]);
-	}
-
-	// Recursive into children nodes
-	for (size_t i = 0; i < node.children.size(); i++) {
-		assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
-		bindModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
-	}
-}
-
-std::vector<PrimitiveObject> gltfObj::bindModel(tinygltf::Model &model) {
-	std::vector<PrimitiveObject> primitiveObjects;
+			// Draw call
+			primitiveObject.mesh = m;
+			primitiveObject.mode = primitive.mode;
+			primitiveObject.indexCount = primitive.indexCount;
+			primitiveObject.indexType = data.indexType;
+			primitiveObject.indexOffset = primitive.firstIndex * indexSize;
+			primitiveObject.baseVertex = primitive.baseVertex;
+
+			// Coarser levels share the vertices, only their index range changes
+			primitiveObject.lodCount = primitive.lodCount;
+			for (GLuint l = 0; l < primitive.lodCount; l++) {
+				primitiveObject.lodIndexCount[l] = primitive.lodIndexCount[l];
+				primitiveObject.lodIndexOffset[l] = primitive.lodFirstIndex[l] * indexSize;
+			}
 
-	const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-	for (size_t i = 0; i < scene.nodes.size(); ++i) {
-		assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-		bindModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+			// Store in the general vector
+			primitiveObjects.push_back(primitiveObject);
+		}
 	}
 
 	return primitiveObjects;
 }
 
-void gltfObj::drawMesh(const std::vector<PrimitiveObject> &primitiveObjects,
-			tinygltf::Model &model, tinygltf::Mesh &mesh) {
+void gltfObj::drawMesh(const std::vector<PrimitiveObject> &primitiveObjects, int meshIndex) {
 
-	for (size_t i = 0; i < mesh.primitives.size(); ++i)
+	for (size_t i = 0; i < primitiveObjects.size(); ++i)
 	{
-		GLuint vao = primitiveObjects[i].vao;
-		std::map<int, GLuint> vbos = primitiveObjects[i].vbos;
-
-		glBindVertexArray(vao);
+		const PrimitiveObject &primitiveObject = primitiveObjects[i];
+		if (primitiveObject.mesh != meshIndex) {
+			continue;
+		}
 
-		if (instancingON)
+		// Send material info, the depth variant has none
+		if (passUniforms->baseColorFactor >= 0)
 		{
-			// Send the instantiation matrices
-			std::size_t rowSize = sizeof(glm::vec4);
-
-			glBindBuffer(GL_ARRAY_BUFFER, i_modelMatBuffer);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, instanced * sizeof(glm::mat4), &modelMat[0]);
-
-			// We use 4 indexes because the maximum amount of possible data per index is 4 (vec4), it will still be received as mat4 in 5
-			glEnableVertexAttribArray(5);
-			glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, (void*)0);
-
-			glEnableVertexAttribArray(6);
-			glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, (void*)(1 * rowSize));
-
-			glEnableVertexAttribArray(7);
-			glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, (void*)(2 * rowSize));
-
-			glEnableVertexAttribArray(8);
-			glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, (void*)(3 * rowSize));
-
-			// This tells us that each matrix will be used for each instance
-			glVertexAttribDivisor(5, 1);
-			glVertexAttribDivisor(6, 1);
-			glVertexAttribDivisor(7, 1);
-			glVertexAttribDivisor(8, 1);
+			glUniform4fv(passUniforms->baseColorFactor, 1, &primitiveObject.material.BaseColorFactor[0]);
+			glUniform1fv(passUniforms->metallicFactor, 1, &primitiveObject.material.MetallicFactor);
+			glUniform1fv(passUniforms->roughnessFactor, 1, &primitiveObject.material.RoughnessFactor);
 		}
 
-		tinygltf::Primitive primitive = mesh.primitives[i];
-		tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-
-		// Send material info
-		glUniform4fv(materialUniID, 1, &primitiveObjects[i].material.BaseColorFactor[0]);
-		glUniform1fv(metallicUniID, 1, &primitiveObjects[i].material.MetallicFactor);
-		glUniform1fv(roughnessUniID, 1, &primitiveObjects[i].material.RoughnessFactor);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
+		// Primitives with fewer levels use their coarsest one
+		GLuint level = std::min(drawLod, primitiveObject.lodCount - 1);
 
 		// Draw with instancing if there is, draws normally if not
 		if (instancingON)
 		{
-			glDrawElementsInstanced(primitive.mode, indexAccessor.count,
-						indexAccessor.componentType,
-						BUFFER_OFFSET(indexAccessor.byteOffset),
-						instanced);
+			glDrawElementsInstancedBaseVertex(primitiveObject.mode, primitiveObject.lodIndexCount[level],
+						primitiveObject.indexType,
+						BUFFER_OFFSET(primitiveObject.lodIndexOffset[level]),
+						drawCount, primitiveObject.baseVertex);
 		} else
 		{
-			glDrawElements(primitive.mode, indexAccessor.count,
-			indexAccessor.componentType,
-			BUFFER_OFFSET(indexAccessor.byteOffset)
+			glDrawElementsBaseVertex(primitiveObject.mode, primitiveObject.lodIndexCount[level],
+			primitiveObject.indexType,
+			BUFFER_OFFSET(primitiveObject.lodIndexOffset[level]),
+			primitiveObject.baseVertex
 			);
 		}
-		glBindVertexArray(0);
 	}
 }
 
 void gltfObj::drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects,
-					tinygltf::Model &model, tinygltf::Node &node) {
+					const ModelData &data, int nodeIndex) {
+	const NodeData &node = data.nodes[nodeIndex];
+
 	// Draw the mesh at the node, and recursively do so for children nodes
-	if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-		drawMesh(primitiveObjects, model, model.meshes[node.mesh]);
+	if ((node.mesh >= 0) && (node.mesh < (int)data.meshes.size())) {
+		drawMesh(primitiveObjects, node.mesh);
 	}
 	for (size_t i = 0; i < node.children.size(); i++) {
-		drawModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+		drawModelNodes(primitiveObjects, data, node.children[i]);
 	}
 }
 void gltfObj::drawModel(const std::vector<PrimitiveObject>& primitiveObjects,
-			tinygltf::Model &model) {
+			const ModelData &data) {
+	// Every primitive draws from the same vao, instance streams included
+	glBindVertexArray(instancingON ? drawVAO : modelAsset->vao);
+
 	// Draw all nodes
-	const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-	for (size_t i = 0; i < scene.nodes.size(); ++i) {
-		drawModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+	for (size_t i = 0; i < data.sceneNodes.size(); ++i) {
+		drawModelNodes(primitiveObjects, data, data.sceneNodes[i]);
 	}
+
+	// The vao stays bound, the next object using it skips the bind (see glState)
 }
 
-void gltfObj::init(GLuint programID, GLuint depthProgramID, int blockBindID, const char *filename,const char *texturePath) {
+// One drawModel per level of detail submit kept instances at, just the one of the object otherwise
+void gltfObj::drawLods(RenderPass pass) {
+	if (!instancingON) {
+		drawLod = lod;
+		drawModel(modelAsset->primitiveObjects, modelAsset->data);
+		return;
+	}
 
-	// Modify your path if needed
-	if (!loadModel(model, filename)) {
+	for (GLuint l = 0; l < maxLods; l++) {
+		if (lodInstances[pass][l] > 0) {
+			drawCount = lodInstances[pass][l];
+			drawLod = l;
+			drawVAO = instanceVAOs[pass][l];
+			drawModel(modelAsset->primitiveObjects, modelAsset->data);
+		}
+	}
+}
+
+void gltfObj::init(GLuint shaderFeatures, const char *filename,const char *texturePath) {
+	prepare(NULL, filename, texturePath);
+	commit(shaderFeatures);
+}
+
+// CPU side of the loading, nothing here touches OpenGL so it can run on the pool's workers
+void gltfObj::prepareAsset(ModelAsset *asset)
+{
+	// Uses the baked file when there is an up to date one
+	if (!loadModelData(asset->path.c_str(), asset->data)) {
 		return;
 	}
 
-	// Generate the modelMat if there is no instancing
-	if (!instancingON)
+	asset->prepared = true;
+}
+
+// Get the shared assets and queue their CPU preparation, the pool must be done before commit is called
+void gltfObj::prepare(ThreadPool *pool, const char *filename, const char *texturePath)
+{
+	// The shared model is only prepared by the first object asking for it
+	modelAsset = acquireModel(filename);
+	if (!modelAsset->queued)
 	{
-		modelMat = new glm::mat4[instanced];
-		genModelMat(position,scale);
+		modelAsset->queued = true;
+
+		ModelAsset *asset = modelAsset;
+		if (pool != NULL)
+		{
+			pool->submit([this, asset] { prepareAsset(asset); });
+		}
+		else
+		{
+			prepareAsset(asset);
+		}
 	}
 
-	// Prepare materials for meshes
-	materialObjects = bindMaterials(model);
+	// Handling textures
+	if (texturePath != NULL){
+		textureAsset = acquireTexture(texturePath, pool);
+	}
+}
 
-	// Prepare buffers for rendering
-	primitiveObjects = bindModel(model);
+// GL side of the loading, must run on the render thread
+void gltfObj::commit(GLuint shaderFeatures) {
 
-	// Prepare joint matrices
-	skinObjects = prepareSkinning(model);
+	if (modelAsset == NULL || !modelAsset->prepared) {
+		releaseModel(modelAsset);
+		modelAsset = NULL;
+		return;
+	}
 
-	// Get shader program
-	this -> programID = programID;
-	this -> blockBindID = blockBindID;
+	// The triangles are read before the CPU buffers are dropped
+	if (occluder != NULL)
+	{
+		buildOccluder();
+	}
 
-	// Get a handle for GLSL variables
-	mvpMatrixID = glGetUniformLocation(programID, "MVP");
-	lightPositionID = glGetUniformLocation(programID, "lightPosition");
-	lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+	// Prepare buffers for rendering, only once for every user of the model
+	if (!modelAsset->committed)
+	{
+		modelAsset->primitiveObjects = bindModel(modelAsset);
+		modelAsset->committed = true;
 
-	materialUniID = glGetUniformLocation(programID, "baseColorFactor");
-	metallicUniID = glGetUniformLocation(programID, "metallicFactor");
-	roughnessUniID = glGetUniformLocation(programID, "roughnessFactor");
+		// Bind pose joint matrices, shared by every object that does not animate
+		const std::vector<glm::mat4> &bindPose = modelAsset->data.skins[0].jointMatrices;
+		glGenBuffers(1, &modelAsset->bindPoseBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, modelAsset->bindPoseBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, bindPose.size() * sizeof(glm::mat4), bindPose.data(), GL_STATIC_DRAW);
 
-	// Handling textures
-	if (texturePath != NULL){
-		textureID = LoadTextureTileBox(texturePath);
-		textureSamplerID  = glGetUniformLocation(programID,"textureSampler");
-		this -> validTexture = 1.0f;
+		// The GPU has its copy, no need to keep the file content around (the batch drops it once built)
+		if (batch == NULL)
+		{
+			releaseModelBuffers(modelAsset->data);
+		}
 	}
-	validTextureTestID = glGetUniformLocation(programID, "validTexture");
 
-	// Generate what's necessary for the passage of the jointMatrices to the shader
-	glGenBuffers(1, &jointMatricesID);
-	glBindBuffer(GL_UNIFORM_BUFFER, jointMatricesID);
-	glBufferData(GL_UNIFORM_BUFFER, skinObjects[0].jointMatrices.size() * sizeof(glm::mat4), skinObjects[0].jointMatrices.data(), GL_DYNAMIC_DRAW);
+	// Record the instance streams once, the buffer itself comes from init_i
+	if (instancingON)
+	{
+		bindInstanceAttributes();
+	}
 
-	// Creating a uniform block index
-	ubo_jointMatricesID = glGetUniformBlockIndex(programID, "jointMatrices");
-	glUniformBlockBinding(programID, ubo_jointMatricesID, blockBindID);  // 0 est le binding point du UBO
-	glBindBufferBase(GL_UNIFORM_BUFFER, blockBindID, jointMatricesID);
+	// Generate the modelMat if there is no instancing
+	if (!instancingON)
+	{
+		modelMat = new glm::mat4[instanced];
+		genModelMat(position,scale);
+	}
 
-	// If shadows are enables, allocate the necessary resources
-	if (shadowsON)
+	// Culling sphere around the model, placed per instance when the matrices are built
+	boundsCenter = (modelAsset->data.boundsMin + modelAsset->data.boundsMax) * 0.5f;
+	boundsRadius = glm::length(modelAsset->data.boundsMax - modelAsset->data.boundsMin) * 0.5f;
+	if (instancingON)
 	{
-		// Setting up variables
-		this -> depthProgramID = depthProgramID;
+		instanceSpheres.resize(instanced);
+		instanceLods.assign(instanced, 0);
+	}
 
-		// Depth texture
-		depthTextureSamplerID  = glGetUniformLocation(programID,"depthTextureSampler");
+	// Every object animates its own copy of the joint matrices
+	skinObjects = modelAsset->data.skins;
 
-		// Handle for variables
-		lvpMatrixID = glGetUniformLocation(programID, "LVP");
+	// Handling textures
+	if (textureAsset != NULL){
+		textureID = commitTexture(textureAsset);
 	}
 
-	// Creates the necessary animating elements if they are enabled
+	// Only animated objects need their own joint matrices, the others read the model's bind pose
+	jointMatricesSize = skinObjects[0].jointMatrices.size() * sizeof(glm::mat4);
 	if (animationON)
 	{
-		// Prepare animation data
-		animationObjects = prepareAnimation(model);
+		// Poses go through the frame stream, this buffer is only used when it is full
+		glGenBuffers(1, &jointMatricesID);
+		glBindBuffer(GL_UNIFORM_BUFFER, jointMatricesID);
+		glBufferData(GL_UNIFORM_BUFFER, jointMatricesSize, skinObjects[0].jointMatrices.data(), GL_DYNAMIC_DRAW);
+		jointMatricesDirty = true;
+	}
+	else
+	{
+		jointMatricesID = modelAsset->bindPoseBuffer;
+	}
+	jointMatricesBuffer = jointMatricesID;
+
+	// The object state picks the rest of the variant, shadows are only received when the object was set up for them
+	if (!shadowsON) {
+		shaderFeatures &= ~obj_s;
+	}
+	if (instancingON) {
+		shaderFeatures |= obj_i;
+	}
+	if (!skinObjects.empty()) {
+		shaderFeatures |= obj_a;
+	}
+	if (textureAsset != NULL) {
+		shaderFeatures |= obj_tex;
+	}
+	this -> shaderFeatures = shaderFeatures;
+	this -> depthShaderFeatures = obj_dpth | (shaderFeatures & (obj_i | obj_a));
+
+	// Compiled with everything else queued on the first render, batched objects use the batch variants
+	if (batch == NULL)
+	{
+		queueObjProgram(this -> shaderFeatures);
+		queueObjProgram(this -> depthShaderFeatures);
 	}
 }
 
+// Fetch the shader variants and their handles, done on first use so every variant is built in one batch
+void gltfObj::bindPrograms() {
+	programID = getObjProgram(shaderFeatures);
+	depthProgramID = getObjProgram(depthShaderFeatures);
+	uniforms = &getObjUniforms(shaderFeatures);
+	depthUniforms = &getObjUniforms(depthShaderFeatures);
+
+	// The joint matrices block reads the same binding point in every program
+	jointMatricesBinding = getBlockBinding("jointMatrices");
+	programsBound = true;
+}
+
 // Init the position,scale,rotation angle and axis, must be used first, NECESSARY
 void gltfObj::init_plmt(glm::vec3 position, glm::vec3 scale, glm::vec3 rotationAxis,GLfloat rotationAngle)
 {
@@ -482,18 +419,41 @@ void gltfObj::init_i(GLuint amount, GLfloat *pos_i, GLfloat *scale_i, GLfloat *r
 	modelMat = new glm::mat4[amount];
 	genModelMat(position,scale);
 
-	// Putting the data in the buffers
+	// The visible instances of each pass and level are compacted in their own block, the vaos read them in place
 	glGenBuffers(1, &i_modelMatBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, i_modelMatBuffer);
-	glBufferData(GL_ARRAY_BUFFER, instanced * sizeof(glm::mat4), &modelMat[0], GL_DYNAMIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, (passOpaque + 1) * maxLods * instanced * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+}
+
+// Merges the object in a static batch, must be done before commit
+void gltfObj::init_b(StaticBatch *batch)
+{
+	this -> batch = batch;
+	batch->add(this);
+}
+
+void gltfObj::init_imp(Impostor *impostor)
+{
+	this -> impostor = impostor;
+	impostor->add(this);
+}
+
+void gltfObj::init_occ(SoftOcclusion *occluder)
+{
+	this -> occluder = occluder;
 }
 
 // Used to generate model matrices using a given position and scale, will create a single matrix in modelMat[0] if there is no instancing
-void gltfObj::genModelMat(glm::vec3 position,glm::vec3 scale)
+// Only the instances in [first, end) are generated, end = 0 means all of them
+void gltfObj::genModelMat(glm::vec3 position,glm::vec3 scale, GLuint first, GLuint end)
 {
 	if (instancingON)
 	{
-		for(unsigned int i = 0; i < instanced*3; i += 3)
+		if (end == 0 || end > instanced)
+		{
+			end = instanced;
+		}
+		for(unsigned int i = first*3; i < end*3; i += 3)
 		{
 			glm::mat4 model = glm::mat4(1.0f);
 			model = glm::translate(model, position + glm::vec3(pos_i[i], pos_i[i+1],pos_i[i+2]));
@@ -515,109 +475,613 @@ void gltfObj::genModelMat(glm::vec3 position,glm::vec3 scale)
 	}
 }
 
+// Flags instances whose offsets changed, they are rebuilt and uploaded on the next render
+void gltfObj::markInstancesDirty(GLuint first, GLuint count)
+{
+	GLuint end = std::min(first + count, instanced);
+	if (first >= end)
+	{
+		return;
+	}
+
+	if (dirtyFirst == dirtyEnd)
+	{
+		dirtyFirst = first;
+		dirtyEnd = end;
+	}
+	else
+	{
+		dirtyFirst = std::min(dirtyFirst, first);
+		dirtyEnd = std::max(dirtyEnd, end);
+	}
+}
+
+// Rebuild the model matrices that changed since the last call, nothing happens for static objects
+bool gltfObj::updateModelMat()
+{
+	glm::vec3 currentPosition = position*posMod;
+	glm::vec3 currentScale = scale*scaleMod;
+
+	// Any change of the shared transform moves every instance
+	if (!modelMatBuilt || currentPosition != builtPosition || currentScale != builtScale
+		|| rotationAxis != builtRotationAxis || rotationAngle != builtRotationAngle)
+	{
+		dirtyFirst = 0;
+		dirtyEnd = instanced;
+
+		builtPosition = currentPosition;
+		builtScale = currentScale;
+		builtRotationAxis = rotationAxis;
+		builtRotationAngle = rotationAngle;
+		modelMatBuilt = true;
+	}
+
+	if (dirtyFirst == dirtyEnd)
+	{
+		return false;
+	}
+
+	genModelMat(currentPosition, currentScale, dirtyFirst, dirtyEnd);
+
+	// Only the changed range gets new culling spheres, the instance buffer is filled per pass by cullInstances
+	if (instancingON)
+	{
+		for (GLuint i = dirtyFirst; i < dirtyEnd; i++)
+		{
+			instanceSpheres.setTransformed(i, modelMat[i], boundsCenter, boundsRadius);
+		}
+	}
+
+	matricesVersion++;
+	dirtyFirst = 0;
+	dirtyEnd = 0;
+	return true;
+}
+
+// Write the joint matrices once per new pose, whichever pass comes first, in the frame stream when it has room
+void gltfObj::uploadJointMatrices()
+{
+	if (!animationON || (!jointMatricesDirty && frameStream.isCurrent(jointMatricesFrame)))
+	{
+		return;
+	}
+
+	if (frameStream.write(skinObjects[0].jointMatrices.data(), jointMatricesSize, jointMatricesOffset))
+	{
+		jointMatricesBuffer = frameStream.buffer;
+	}
+	else
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, jointMatricesID);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, jointMatricesSize, skinObjects[0].jointMatrices.data());
+		jointMatricesBuffer = jointMatricesID;
+		jointMatricesOffset = 0;
+	}
+	jointMatricesFrame = frameStream.frame;
+	jointMatricesDirty = false;
+}
+
+// BVH callback, proxies point at their object
+static void objectBounds(void *object, AABB &box)
+{
+	static_cast<gltfObj *>(object)->computeBounds(box);
+}
+
+void gltfObj::insertBVH(SceneBVH *bvh)
+{
+	if (modelAsset == NULL)
+	{
+		return;
+	}
+	this -> bvh = bvh;
+	bvhProxy = bvh->createProxy(this, objectBounds);
+}
+
+void gltfObj::insertOcclusion(OcclusionQueries *occlusion)
+{
+	if (modelAsset == NULL)
+	{
+		return;
+	}
+	this -> occlusion = occlusion;
+	occlusionProxy = occlusion->createProxy();
+}
+
+// World box around every instance, only rebuilt when the matrices are
+void gltfObj::computeBounds(AABB &box)
+{
+	AABB modelBox;
+	modelBox.min = modelAsset->data.boundsMin;
+	modelBox.max = modelAsset->data.boundsMax;
+
+	// The batch places its members without the mod values and scales all of it (see staticBatch)
+	if (batch != NULL)
+	{
+		if (!worldBoxBuilt)
+		{
+			genModelMat(position, scale);
+			worldBox = transformBox(modelBox, modelMat[0]);
+			for (GLuint i = 1; i < instanced; i++)
+			{
+				worldBox = mergeBoxes(worldBox, transformBox(modelBox, modelMat[i]));
+			}
+			worldBoxBuilt = true;
+		}
+		box.min = worldBox.min * posMod;
+		box.max = worldBox.max * posMod;
+		return;
+	}
+
+	if (updateModelMat() || !worldBoxBuilt)
+	{
+		worldBox = transformBox(modelBox, modelMat[0]);
+		for (GLuint i = 1; i < instanced; i++)
+		{
+			worldBox = mergeBoxes(worldBox, transformBox(modelBox, modelMat[i]));
+		}
+		worldBoxBuilt = true;
+	}
+	box = worldBox;
+}
+
+// Every instance of the object as the SoftOcclusion draws it, the batch members are scaled by the batch
+static void occluderMatrices(void *object, std::vector<glm::mat4> &models)
+{
+	gltfObj *obj = static_cast<gltfObj *>(object);
+
+	// Brings the matrices up to date
+	AABB box;
+	obj->computeBounds(box);
+
+	glm::mat4 modMat(1.0f);
+	if (obj->batch != NULL)
+	{
+		modMat = glm::scale(glm::mat4(1.0f), glm::vec3(obj->posMod));
+	}
+	for (GLuint i = 0; i < obj->instanced; i++)
+	{
+		models.push_back(modMat * obj->modelMat[i]);
+	}
+}
+
+// Full level of every triangle list in bind pose, the model matrices are applied when rasterizing
+// The simplified levels can bulge out of the surface, they would hide what the real one leaves visible
+void gltfObj::buildOccluder()
+{
+	const ModelData &data = modelAsset->data;
+	if (data.vertices == NULL || data.indices == NULL)
+	{
+		std::cerr << "Occluder without its CPU buffers, it will not hide anything." << std::endl;
+		occluder = NULL;
+		return;
+	}
+
+	std::vector<glm::vec3> triangles;
+	for (size_t i = 0; i < data.sceneNodes.size(); i++)
+	{
+		appendOccluderNode(data.sceneNodes[i], triangles);
+	}
+	occluderIndex = occluder->addOccluder(triangles, this, occluderMatrices);
+}
+
+// Same traversal as drawModelNodes
+void gltfObj::appendOccluderNode(int nodeIndex, std::vector<glm::vec3> &triangles)
+{
+	const ModelData &data = modelAsset->data;
+	const NodeData &node = data.nodes[nodeIndex];
+
+	if ((node.mesh >= 0) && (node.mesh < (int)data.meshes.size())) {
+		const std::vector<glm::mat4> &bindPose = data.skins[0].jointMatrices;
+		const MeshData &mesh = data.meshes[node.mesh];
+		for (size_t p = 0; p < mesh.primitives.size(); p++) {
+			const PrimitiveData &primitive = mesh.primitives[p];
+			if (primitive.mode != GL_TRIANGLES) {
+				continue;
+			}
+
+			GLuint first = primitive.firstIndex;
+			GLuint count = primitive.indexCount;
+			for (GLuint i = 0; i < count; i++) {
+				GLuint index = (data.indexType == GL_UNSIGNED_INT) ? ((const GLuint *)data.indices)[first + i] : ((const GLushort *)data.indices)[first + i];
+				const Vertex &vertex = data.vertices[primitive.baseVertex + index];
+
+				// Same normalised weights as the SKINNING variant
+				glm::mat4 skinMat(1.0f);
+				float totalWeight = vertex.weights.x + vertex.weights.y + vertex.weights.z + vertex.weights.w;
+				if (!bindPose.empty() && totalWeight > 0.0f) {
+					skinMat = glm::mat4(0.0f);
+					for (int j = 0; j < 4; j++) {
+						skinMat += bindPose[vertex.joints[j]] * (vertex.weights[j] / totalWeight);
+					}
+				}
+				triangles.push_back(glm::vec3(skinMat * glm::vec4(vertex.position, 1.0f)));
+			}
+		}
+	}
+	for (size_t i = 0; i < node.children.size(); i++) {
+		appendOccluderNode(node.children[i], triangles);
+	}
+}
+
+// Orders the visible instances by level, front to back within each
+struct LodOrder {
+	const std::vector<unsigned char> *lods;
+
+	bool operator()(GLuint a, GLuint b) const { return (*lods)[a] < (*lods)[b]; }
+};
+
+// Keep the instances whose sphere touches the frustum, closest first per level of detail, and write their matrices where the pass will read them
+bool gltfObj::cullInstances(RenderPass pass, const glm::mat4 &viewProjection, glm::vec3 viewer, const FrameContext &context)
+{
+	cullSpheres(frustumFromMatrix(viewProjection), instanceSpheres, visibleInstances);
+
+	// Then those fully behind the CPU occluders
+	if (pass == passOpaque && context.softOcclusion != NULL && occluder == NULL)
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < visibleInstances.size(); i++)
+		{
+			GLuint s = visibleInstances[i];
+			glm::vec3 center(instanceSpheres.x[s], instanceSpheres.y[s], instanceSpheres.z[s]);
+			if (!context.softOcclusion->isSphereOccluded(center, instanceSpheres.radius[s]))
+			{
+				visibleInstances[kept++] = s;
+			}
+		}
+		visibleInstances.resize(kept);
+	}
+	sortFrontToBack(instanceSpheres, viewer, visibleInstances);
+
+	for (GLuint l = 0; l < maxLods; l++)
+	{
+		lodInstances[pass][l] = 0;
+	}
+	if (visibleInstances.empty())
+	{
+		return false;
+	}
+
+	// The levels are picked from the camera in every pass, the shadows match what is seen
+	selectLods(instanceSpheres, visibleInstances, context.eye, context.lodScale, instanceLods);
+	LodOrder order = {&instanceLods};
+	std::stable_sort(visibleInstances.begin(), visibleInstances.end(), order);
+
+	// The farthest levels are last, they go to the impostor instead
+	if (impostor != NULL && impostor->baked)
+	{
+		while (!visibleInstances.empty() && instanceLods[visibleInstances.back()] >= impostorLod)
+		{
+			impostor->addInstance(pass, modelMat[visibleInstances.back()]);
+			visibleInstances.pop_back();
+		}
+		if (visibleInstances.empty())
+		{
+			return false;
+		}
+	}
+
+	GLuint lodFirst[maxLods] = {};     // Visible instances of each level follow each other
+	for (size_t i = 0; i < visibleInstances.size(); i++)
+	{
+		GLuint level = std::min((GLuint)instanceLods[visibleInstances[i]], (GLuint)maxLods - 1);
+		if (lodInstances[pass][level]++ == 0)
+		{
+			lodFirst[level] = i;
+		}
+	}
+
+	// Same instances at the same levels and no matrix rebuilt, the blocks of the pass still hold them
+	if (uploadedVersion[pass] == matricesVersion && visibleInstances == uploadedInstances[pass]
+		&& std::equal(lodInstances[pass], lodInstances[pass] + maxLods, uploadedLods[pass]))
+	{
+		return true;
+	}
+	uploadedInstances[pass] = visibleInstances;
+	std::copy(lodInstances[pass], lodInstances[pass] + maxLods, uploadedLods[pass]);
+	uploadedVersion[pass] = matricesVersion;
+
+	visibleMat.resize(visibleInstances.size());
+	for (size_t i = 0; i < visibleInstances.size(); i++)
+	{
+		visibleMat[i] = modelMat[visibleInstances[i]];
+	}
+
+	// One write in the frame stream, the GPU then copies each level in its block
+	GLintptr streamOffset = 0;
+	bool streamed = frameStream.write(visibleMat.data(), visibleMat.size() * sizeof(glm::mat4), streamOffset);
+	if (streamed)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, frameStream.buffer);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, i_modelMatBuffer);
+	for (GLuint l = 0; l < maxLods; l++)
+	{
+		if (lodInstances[pass][l] == 0)
+		{
+			continue;
+		}
+
+		GLsizeiptr size = lodInstances[pass][l] * sizeof(glm::mat4);
+		if (streamed)
+		{
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				streamOffset + lodFirst[l] * sizeof(glm::mat4), instanceBlockOffset(pass, l), size);
+		}
+		else
+		{
+			// The stream is full this frame, the level is uploaded straight to its block
+			glBufferSubData(GL_COPY_WRITE_BUFFER, instanceBlockOffset(pass, l), size, &visibleMat[lodFirst[l]]);
+		}
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
+
 // Render made to give information to the depth buffer only, will not output visuals, very minimal
-void gltfObj::depthRender(glm::mat4 lightViewMatrix) {
+// The pre-pass gives the camera matrix and draws the instances of the opaque pass
+void gltfObj::depthRender(glm::mat4 lightViewMatrix, RenderPass instancesPass) {
+	if (!programsBound) {
+		bindPrograms();
+	}
 	glUseProgram(depthProgramID);
+	passUniforms = depthUniforms;
 
 	// Set transforms
 
-	// Change the data of the model matrix(es)
-	genModelMat(position*posMod,scale*scaleMod);
+	// Change the data of the model matrix(es) if they moved
+	updateModelMat();
 
 	if (instancingON)
 	{
 		// Set camera
 		glm::mat4 mvp = lightViewMatrix;
-		glUniformMatrix4fv(glGetUniformLocation(depthProgramID, "MVP"), 1, GL_FALSE, &mvp[0][0]);
+		glUniformMatrix4fv(depthUniforms->mvp, 1, GL_FALSE, &mvp[0][0]);
 	}
 	else
 	{
 		// Set camera
 		glm::mat4 mvp = lightViewMatrix*modelMat[0];
-		glUniformMatrix4fv(glGetUniformLocation(depthProgramID, "MVP"), 1, GL_FALSE, &mvp[0][0]);
+		glUniformMatrix4fv(depthUniforms->mvp, 1, GL_FALSE, &mvp[0][0]);
+	}
+
+	// Send the pose if update made a new one, then put it on the binding point the program reads
+	uploadJointMatrices();
+	glBindBufferRange(GL_UNIFORM_BUFFER, jointMatricesBinding, jointMatricesBuffer, jointMatricesOffset, jointMatricesSize);
+
+	// Draw the GLTF model, only the instances submit kept for this pass, skipped like render does when hidden
+	bool conditional = (instancesPass == passOpaque) && (occlusion != NULL) && occlusion->beginConditional(occlusionProxy);
+	drawLods(instancesPass);
+	if (conditional)
+	{
+		glEndConditionalRender();
+	}
+}
+
+// Queue callback, packets point at their object
+static void drawObject(void *object, RenderPass pass, const FrameContext &context)
+{
+	gltfObj *obj = static_cast<gltfObj *>(object);
+	if (pass == passDepth)
+	{
+		obj->depthRender(context.lightMatrix);
 	}
+	else if (pass == passPrepass)
+	{
+		obj->depthRender(context.cameraMatrix, passOpaque);
+	}
+	else
+	{
+		obj->render(context.cameraMatrix, context.lightPosition, context.lightIntensity, context.lightMatrix, context.depthTexture);
+	}
+}
 
-	// Use the relevant blockBind buffer
-	glUniformBlockBinding(depthProgramID, glGetUniformBlockIndex(depthProgramID, "jointMatrices"), blockBindID);  // 0 est le binding point du UBO
-	glBindBufferBase(GL_UNIFORM_BUFFER, blockBindID, jointMatricesID);
+// Queue the object for a pass, sorted by program, texture, vao then distance to the viewer (the light for depth)
+void gltfObj::submit(RenderQueue &queue, RenderPass pass, const FrameContext &context, float maxDistance)
+{
+	if (modelAsset == NULL)
+	{
+		return;
+	}
+
+	// The frustum of this pass missed the whole object
+	if (bvh != NULL && !bvh->isVisible(bvhProxy, pass))
+	{
+		return;
+	}
+
+	// The box is queried for the next frames, render skips the draw on the GPU while it is hidden
+	if (occlusion != NULL && pass == passOpaque)
+	{
+		AABB box;
+		computeBounds(box);
+		occlusion->test(occlusionProxy, box);
+
+		// Batch members can only be left out of the batch draw, from the results already there
+		if (batch != NULL && occlusion->isOccluded(occlusionProxy))
+		{
+			return;
+		}
+	}
+
+	// The CPU depth buffer of this frame, nothing is queued while the box is behind the occluders (which skip it)
+	if (context.softOcclusion != NULL && pass == passOpaque && occluder == NULL)
+	{
+		AABB box;
+		computeBounds(box);
+		if (context.softOcclusion->isBoxOccluded(box.min, box.max))
+		{
+			return;
+		}
+	}
+
+	// The batch draws us along with the other members
+	if (batch != NULL)
+	{
+		batch->mark(batchSlot, pass);
+		return;
+	}
+
+	if (!programsBound) {
+		bindPrograms();
+	}
+
+	glm::vec3 viewer = (pass == passDepth) ? context.lightPosition : context.eye;
+	float depth = glm::length(position*posMod - viewer) / maxDistance;
+
+	// Instances outside of the pass frustum are dropped here, nothing is queued if none is left
+	updateModelMat();
+	if (instancingON)
+	{
+		glm::mat4 viewProjection = (pass == passDepth) ? context.lightMatrix : context.cameraMatrix;
+		if (!cullInstances(pass, viewProjection, viewer, context))
+		{
+			return;
+		}
+	}
+	else
+	{
+		// Always from the camera, the shadow is cast by what is seen
+		glm::vec3 center = glm::vec3(modelMat[0] * glm::vec4(boundsCenter, 1.0f));
+		float radius = boundsRadius * matrixScale(modelMat[0]);
+		float distance = std::max(glm::length(center - context.eye), radius);
+		if (distance > 0.0f)
+		{
+			lod = selectLod(radius * context.lodScale / distance, lod);
+		}
+
+		if (impostor != NULL && impostor->baked && lod >= impostorLod)
+		{
+			impostor->addInstance(pass, modelMat[0]);
+			return;
+		}
+	}
 
-	// Get the data into the buffer for access in the shaders
-	glBindBuffer(GL_UNIFORM_BUFFER, jointMatricesID);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0,skinObjects[0].jointMatrices.size() * sizeof(glm::mat4), skinObjects[0].jointMatrices.data());
+	GLuint program = (pass == passDepth) ? depthProgramID : programID;
+	GLuint texture = (pass == passDepth) ? 0 : textureID;
+	GLuint vao = instancingON ? instanceVAOs[pass][0] : modelAsset->vao;
+	queue.submit(makeSortKey(pass, program, texture, vao, depth), this, drawObject);
 
-	// Draw the GLTF model
-	drawModel(primitiveObjects, model);
+	// Same draw depth only first, the color pass then shades each pixel once
+	if (pass == passOpaque && context.depthPrepass)
+	{
+		queue.submit(makeSortKey(passPrepass, depthProgramID, 0, vao, depth), this, drawObject);
+	}
 }
 
 // Main render, lightMatrix and depthTexture will not be used if shadows are not activated but are still required
 void gltfObj::render(glm::mat4 cameraMatrix, glm::vec3 lightPosition,glm::vec3 lightIntensity, glm::mat4 lightMatrix, GLuint depthTexture)
 {
+	if (!programsBound) {
+		bindPrograms();
+	}
 	glUseProgram(programID);
+	passUniforms = uniforms;
 
-	// Change the data of the model matrix(es)
-	genModelMat(position*posMod,scale*scaleMod);
+	// Change the data of the model matrix(es) if they moved
+	updateModelMat();
 
 	if (instancingON)
 	{
 		// Set camera
 		glm::mat4 mvp = cameraMatrix;
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+		glUniformMatrix4fv(uniforms->mvp, 1, GL_FALSE, &mvp[0][0]);
 
 		if (shadowsON)
 		{
 			// Set light
 			glm::mat4 lvp = lightMatrix;
-			glUniformMatrix4fv(lvpMatrixID, 1, GL_FALSE, &lvp[0][0]);
+			glUniformMatrix4fv(uniforms->lvp, 1, GL_FALSE, &lvp[0][0]);
 		}
 	} else
 	{
 		// Set camera
 		glm::mat4 mvp = cameraMatrix*modelMat[0];
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+		glUniformMatrix4fv(uniforms->mvp, 1, GL_FALSE, &mvp[0][0]);
 
 		if (shadowsON)
 		{
 			// Set light
 			glm::mat4 lvp = lightMatrix*modelMat[0];
-			glUniformMatrix4fv(lvpMatrixID, 1, GL_FALSE, &lvp[0][0]);
+			glUniformMatrix4fv(uniforms->lvp, 1, GL_FALSE, &lvp[0][0]);
 		}
 	}
 
-	// Use the relevant blockBind buffer
-	glUniformBlockBinding(programID, ubo_jointMatricesID, blockBindID);  // 0 est le binding point du UBO
-	glBindBufferBase(GL_UNIFORM_BUFFER, blockBindID, jointMatricesID);
-
-	// Get the data into the buffer for access in the shaders
-	glBindBuffer(GL_UNIFORM_BUFFER, jointMatricesID);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0,skinObjects[0].jointMatrices.size() * sizeof(glm::mat4), skinObjects[0].jointMatrices.data());
+	// Send the pose if update made a new one, then put it on the binding point the program reads
+	uploadJointMatrices();
+	glBindBufferRange(GL_UNIFORM_BUFFER, jointMatricesBinding, jointMatricesBuffer, jointMatricesOffset, jointMatricesSize);
 	// -----------------------------------------------------------------
 	// Handling texture
 
-	if (shadowsON)
+	// The samplers already read their units, only the textures are bound
+	if (uniforms->depthTextureUnit >= 0)
 	{
 		// Set depthBuffer Texture data
-		glActiveTexture(GL_TEXTURE0+7);
+		glActiveTexture(GL_TEXTURE0 + uniforms->depthTextureUnit);
 		glBindTexture(GL_TEXTURE_2D, depthTexture);
-		glUniform1i(depthTextureSamplerID, 7);
 	}
 
-	// Send texture through sampler
-	glActiveTexture(GL_TEXTURE0 + blockBindID + 10);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glUniform1i(textureSamplerID, blockBindID + 10);
-
-	glUniform1fv(validTextureTestID,1,&validTexture);
+	if (uniforms->textureUnit >= 0)
+	{
+		glActiveTexture(GL_TEXTURE0 + uniforms->textureUnit);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+	}
 
 	// Set light data
-	glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-	glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
+	glUniform3fv(uniforms->lightPosition, 1, &lightPosition[0]);
+	glUniform3fv(uniforms->lightIntensity, 1, &lightIntensity[0]);
 
-	// Draw the GLTF model
-	drawModel(primitiveObjects, model);
+	// Draw the GLTF model, only the instances submit kept for this pass, unless the box was hidden last frame
+	bool conditional = (occlusion != NULL) && occlusion->beginConditional(occlusionProxy);
+	drawLods(passOpaque);
+	if (conditional)
+	{
+		glEndConditionalRender();
+	}
 }
 
 void gltfObj::cleanup() {
-	glDeleteProgram(programID);
+	if (bvh != NULL)
+	{
+		bvh->destroyProxy(bvhProxy);
+		bvh = NULL;
+		bvhProxy = -1;
+	}
+	if (occlusion != NULL)
+	{
+		occlusion->destroyProxy(occlusionProxy);
+		occlusion = NULL;
+		occlusionProxy = -1;
+	}
+	if (occluder != NULL)
+	{
+		occluder->removeOccluder(occluderIndex);
+		occluder = NULL;
+		occluderIndex = -1;
+	}
+
+	// Give back the shared resources, the last user frees them (programs belong to the shaderManager)
+	if (modelAsset != NULL)
+	{
+		if (animationON)
+		{
+			glDeleteBuffers(1, &jointMatricesID);
+		}
+		if (instancingON)
+		{
+			glDeleteVertexArrays((passOpaque + 1) * maxLods, &instanceVAOs[0][0]);
+			glDeleteBuffers(1, &i_modelMatBuffer);
+		}
+
+		releaseModel(modelAsset);
+		modelAsset = NULL;
+	}
+	if (textureAsset != NULL)
+	{
+		releaseTexture(textureAsset);
+		textureAsset = NULL;
+		textureID = 0;
+	}
 }
 
 int gltfObj::findKeyframeIndex(const std::vector<float>& times, float animationTime)
@@ -643,117 +1107,45 @@ int gltfObj::findKeyframeIndex(const std::vector<float>& times, float animationT
 	return times.size() - 2;
 }
 
-std::vector<AnimationObject> gltfObj::prepareAnimation(const tinygltf::Model &model)
-{
-	std::vector<AnimationObject> animationObjects;
-	for (const auto &anim : model.animations) {
-		AnimationObject animationObject;
-
-		for (const auto &sampler : anim.samplers) {
-			SamplerObject samplerObject;
-
-			const tinygltf::Accessor &inputAccessor = model.accessors[sampler.input];
-			const tinygltf::BufferView &inputBufferView = model.bufferViews[inputAccessor.bufferView];
-			const tinygltf::Buffer &inputBuffer = model.buffers[inputBufferView.buffer];
-
-			assert(inputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-			assert(inputAccessor.type == TINYGLTF_TYPE_SCALAR);
-
-			// Input (time) values
-			samplerObject.input.resize(inputAccessor.count);
-
-			const unsigned char *inputPtr = &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset];
-			const float *inputBuf = reinterpret_cast<const float*>(inputPtr);
-
-			// Read input (time) values
-			int stride = inputAccessor.ByteStride(inputBufferView);
-			for (size_t i = 0; i < inputAccessor.count; ++i) {
-				samplerObject.input[i] = *reinterpret_cast<const float*>(inputPtr + i * stride);
-			}
-
-			const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
-			const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-			const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
-
-			assert(outputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-			const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-			const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
-
-			int outputStride = outputAccessor.ByteStride(outputBufferView);
-
-			// Output values
-			samplerObject.output.resize(outputAccessor.count);
-
-			for (size_t i = 0; i < outputAccessor.count; ++i) {
-
-				if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
-					memcpy(&samplerObject.output[i], outputPtr + i * 3 * sizeof(float), 3 * sizeof(float));
-				} else if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
-					memcpy(&samplerObject.output[i], outputPtr + i * 4 * sizeof(float), 4 * sizeof(float));
-				} else {
-					std::cout << "Unsupport accessor type ..." << std::endl;
-				}
-
-			}
-
-			animationObject.samplers.push_back(samplerObject);
-		}
-
-		animationObjects.push_back(animationObject);
-	}
-	return animationObjects;
-}
-
 void gltfObj::updateAnimation(
-	const tinygltf::Model &model,
-	const tinygltf::Animation &anim,
 	const AnimationObject &animationObject,
 	float time,
 	std::vector<glm::mat4> &nodeTransforms)
 {
 	// There are many channels so we have to accumulate the transforms
-	for (const auto &channel : anim.channels) {
+	for (const auto &channel : animationObject.channels) {
 
-		int targetNodeIndex = channel.target_node;
-		const auto &sampler = anim.samplers[channel.sampler];
-
-		// Access output (value) data for the channel
-		const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
-		const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-		const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
+		int targetNodeIndex = channel.targetNode;
+		const SamplerObject &sampler = animationObject.samplers[channel.sampler];
 
 		// Calculate current animation time (wrap if necessary)
-		const std::vector<float> &times = animationObject.samplers[channel.sampler].input;
+		const std::vector<float> &times = sampler.input;
 		float animationTime = fmod(time, times.back());
 
 		// Get animation keyframe
 		int keyframeIndex = findKeyframeIndex(times, animationTime);
 
-		const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-		const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
+		// Output values are stored as vec4, the translations and scales only use xyz
+		const glm::vec4 &output0 = sampler.output[keyframeIndex];
+		const glm::vec4 &output1 = sampler.output[keyframeIndex+1];
 
 		// Creates interpolated position, scale and rotation changes
 		float t = (animationTime - times[keyframeIndex]) / (times[keyframeIndex+1] - times[keyframeIndex]);
 
-		if (channel.target_path == "translation") {
-			glm::vec3 translation0, translation1;
-			memcpy(&translation0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-			memcpy(&translation1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
+		if (channel.targetPath == "translation") {
+			glm::vec3 translation0(output0), translation1(output1);
 
 			glm::vec3 translation = translation0 + t*(translation1-translation0);
 			nodeTransforms[targetNodeIndex] = glm::translate(nodeTransforms[targetNodeIndex], translation);
-		} else if (channel.target_path == "rotation") {
-			glm::quat rotation0, rotation1;
-			memcpy(&rotation0, outputPtr + keyframeIndex * 4 * sizeof(float), 4 * sizeof(float));
-			memcpy(&rotation1, outputPtr + (keyframeIndex+1) * 4 * sizeof(float), 4 * sizeof(float));
+		} else if (channel.targetPath == "rotation") {
+			// GLTF stores x,y,z,w
+			glm::quat rotation0(output0.w, output0.x, output0.y, output0.z);
+			glm::quat rotation1(output1.w, output1.x, output1.y, output1.z);
 
 			glm::quat rotation = slerp(rotation0, rotation1, t);
 			nodeTransforms[targetNodeIndex] *= glm::mat4_cast(rotation);
-		} else if (channel.target_path == "scale") {
-			glm::vec3 scale0, scale1;
-			memcpy(&scale0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-			memcpy(&scale1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
+		} else if (channel.targetPath == "scale") {
+			glm::vec3 scale0(output0), scale1(output1);
 
 			glm::vec3 scale = scale0 + t*(scale1-scale0);
 			nodeTransforms[targetNodeIndex] = glm::scale(nodeTransforms[targetNodeIndex], scale);
@@ -762,39 +1154,41 @@ void gltfObj::updateAnimation(
 }
 
 void gltfObj::updateSkinning(const std::vector<glm::mat4> &nodeTransforms) {
+	const ModelData &data = modelAsset->data;
 
-	for (size_t i = 0; i < model.skins.size(); i++)
+	for (size_t i = 0; i < skinObjects.size(); i++)
 	{
-		const tinygltf::Skin &skin = model.skins[i];
-		SkinObject &skinObject = skinObjects[0];
+		SkinObject &skinObject = skinObjects[i];
 
 		// Get the root node
-		int rootNodeIndex = skin.joints[0];
+		int rootNodeIndex = skinObject.joints[0];
 
 		// Compute the global node transforms
-		computeGlobalNodeTransform(model, nodeTransforms, rootNodeIndex,glm::mat4(1.0f),skinObject.globalJointTransforms);
+		computeGlobalNodeTransform(data, nodeTransforms, rootNodeIndex,glm::mat4(1.0f),skinObject.globalJointTransforms);
 
 		// Calculate the jointmatrices
 		for (size_t h = 0; h < skinObject.jointMatrices.size(); h++)
 		{
-			int nodeIndex = skin.joints[h];
+			int nodeIndex = skinObject.joints[h];
 			skinObject.jointMatrices[h] = skinObject.globalJointTransforms[nodeIndex] * skinObject.inverseBindMatrices[h];
 		}
 	}
+	jointMatricesDirty = true;
 }
 
 void gltfObj::update(float time) {
-	if (model.animations.size() > 0) {
-		const tinygltf::Animation &animation = model.animations[0];
-		const AnimationObject &animationObject = animationObjects[0];
+	const ModelData &data = modelAsset->data;
+
+	// Objects without init_a share the bind pose, there is nothing of theirs to change
+	if (animationON && data.animations.size() > 0) {
+		const AnimationObject &animationObject = data.animations[0];
 
-		const tinygltf::Skin &skin = model.skins[0];
-		std::vector<glm::mat4> nodeTransforms(skin.joints.size());
+		std::vector<glm::mat4> nodeTransforms(data.nodes.size());
 		for (size_t i = 0; i < nodeTransforms.size(); ++i) {
 			nodeTransforms[i] = glm::mat4(1.0);
 		}
-		updateAnimation(model, animation, animationObject, time, nodeTransforms);
+		updateAnimation(animationObject, time, nodeTransforms);
 		updateSkinning(nodeTransforms);
 	}
 
-}
\ No newline at end of file
+}
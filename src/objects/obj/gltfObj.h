@@ -6,6 +6,12 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include <render/shader.h>
+#include <render/shaderManager.h>
+#include <render/renderQueue.h>
+#include <render/frustum.h>
+#include <render/sceneBVH.h>
+#include <render/occlusionQueries.h>
+#include <render/softOcclusion.h>
 
 #include <vector>
 #include <iostream>
@@ -17,10 +23,14 @@
 #include "../commonStructs.h"
 
 #include "helpers.h"
+#include <render/assetCache.h>
 
 #ifndef GLTFOBJ_H
 #define GLTFOBJ_H
 
+struct StaticBatch;
+struct Impostor;
+
 //------------------------------------------------------------------//
 //																	//
 //		This is made to open and display gltf files.                //
@@ -39,18 +49,53 @@
 //          (pos_i, scale_i, rotAngle_i) to be respectively         //
 //          3*"amount", "amount" and "amount" long to work.         //
 //      init_plmt_mod : factor used for scaling position and scale  //
-//      init : Main initialisation, must be done last.              //
+//      init_b : Merges the object in a StaticBatch, for objects    //
+//          that never move nor animate (see staticBatch.h)         //
+//      init_imp : Far instances are drawn as billboards by the     //
+//          Impostor of the model (see impostor.h)                  //
+//      init_occ : The full level of the model is rasterized by the //
+//          SoftOcclusion to hide what is behind the object         //
+//      init : Main initialisation, must be done last, takes the    //
+//          shader features the object wants (obj_l, obj_s), the    //
+//          others follow its own state.                            //
+//          It can also be done in two steps to load many objects   //
+//          at once : prepare (CPU side, queued on a ThreadPool)    //
+//          then commit (GL side) once the pool is done.            //
 //																	//
 //  Rendering :                                                     //
+//      insertBVH : Adds the object to the scene BVH once committed,//
+//          submit then skips the passes whose frustum missed it.   //
+//      insertOcclusion : Same for the occlusion queries, the       //
+//          object is not drawn while its box was hidden last frame.//
+//          The SoftOcclusion of the FrameContext, when there is    //
+//          one, is tested by submit the same way, per instance too.//
+//      submit : Queues the object for a pass of the RenderQueue,   //
+//          which calls depthRender or render once sorted.          //
+//          maxDistance scales the distance part of the key.        //
+//          Instances are culled against the frustum of the pass,   //
+//          the visible ones are compacted front to back in the     //
+//          block of their pass and level, only when they changed.  //
+//          The level of detail (see meshOptimizer) is picked from  //
+//          the size on screen, per instance when instanced.        //
 //      depthRender : Render made to give information to the depth  //
 //          buffer only, will not output visuals, very minimal.     //
+//          Also the depth pre-pass, with the camera matrix and the //
+//          instances kept for the opaque pass.                     //
 //      render :  Main render, lightMatrix and depthTexture will    //
 //          not be used if shadows are not activated but are still  //
 //          required.                                               //
 //																	//
+//  Moving :                                                        //
+//      Matrices are rebuilt only when position,                    //
+//          scale, rotation or the mod values changed since the     //
+//          last render.                                            //
+//      markInstancesDirty : Call after changing pos_i, scale_i or  //
+//          rotationAngle_i, only that range is rebuilt.            //
+//																	//
 //  Animating :                                                     //
 //      update : Changes the mesh to the next frame, using current  //
-//          time. (calculation in main)                             //
+//          time. (calculation in main) Needs init_a, objects       //
+//          without it share their model's bind pose.               //
 //																	//
 //  NB : This struct expects models to have at least one bone.      //
 //       This has only been tested with models from blender with    //
@@ -73,44 +118,56 @@ struct gltfObj {
     void init_plmt_mod(GLfloat posMod = 1.0f,GLfloat scaleMod = 1.0f);
     void init_plmt(glm::vec3 position, glm::vec3 scale, glm::vec3 rotationAxis,GLfloat rotationAngle);
     void init_i(GLuint amount, GLfloat *pos_i, GLfloat *scale_i, GLfloat *rotAngl_i);
-
-    virtual void init(GLuint programID, GLuint depthProgramID, int blockBindID, const char *filename,const char *texturePath);
+    void init_b(StaticBatch *batch);
+    void init_imp(Impostor *impostor);
+    void init_occ(SoftOcclusion *occluder);
+
+    virtual void init(GLuint shaderFeatures, const char *filename,const char *texturePath);
+    void prepare(ThreadPool *pool, const char *filename, const char *texturePath);
+    void commit(GLuint shaderFeatures);
+    void bindPrograms();
     void cleanup();
 
     // Render methods
+    void submit(RenderQueue &queue, RenderPass pass, const FrameContext &context, float maxDistance);
     void render(glm::mat4 cameraMatrix, glm::vec3 lightPosition,glm::vec3 lightIntensity, glm::mat4 lightMatrix = glm::mat4(0.0f), GLuint depthTexture = 0);
-    void depthRender(glm::mat4 lightViewMatrix);
-
-    // Nodes computations
-    glm::mat4 getNodeTransform(const tinygltf::Node& node);
-    void computeLocalNodeTransform(const tinygltf::Model& model, int nodeIndex, std::vector<glm::mat4> &localTransforms);
-    void computeGlobalNodeTransform(const tinygltf::Model& model, const std::vector<glm::mat4> &localTransforms, int nodeIndex, const glm::mat4& parentTransform, std::vector<glm::mat4> &globalTransforms);
+    void depthRender(glm::mat4 lightViewMatrix, RenderPass instancesPass = passDepth);
 
     // Updates fonctions
     void update(float time);
     void updateSkinning(const std::vector<glm::mat4> &nodeTransforms);
-    void updateAnimation(const tinygltf::Model &model, const tinygltf::Animation &anim, const AnimationObject &animationObject, float time, std::vector<glm::mat4> &nodeTransforms);
+    void updateAnimation(const AnimationObject &animationObject, float time, std::vector<glm::mat4> &nodeTransforms);
+    void uploadJointMatrices();
 
-    // Prepare loading
-    std::vector<SkinObject> prepareSkinning(const tinygltf::Model &model);
-    std::vector<AnimationObject> prepareAnimation(const tinygltf::Model &model);
+    // Culling
+    void insertBVH(SceneBVH *bvh);
+    void insertOcclusion(OcclusionQueries *occlusion);
+    void computeBounds(AABB &box);
+    bool cullInstances(RenderPass pass, const glm::mat4 &viewProjection, glm::vec3 viewer, const FrameContext &context);
+    void buildOccluder();
+    void appendOccluderNode(int nodeIndex, std::vector<glm::vec3> &triangles);
 
     // Loading
-    bool loadModel(tinygltf::Model &model, const char *filename);
+    void prepareAsset(ModelAsset *asset);
 
     // Binding
-    std::vector<MaterialObject> bindMaterials(tinygltf::Model &model);
-    void bindMesh(std::vector<PrimitiveObject> &primitiveObjects,tinygltf::Model &model, tinygltf::Mesh &mesh);
-    void bindModelNodes(std::vector<PrimitiveObject> &primitiveObjects,tinygltf::Model &model,tinygltf::Node &node);
-    std::vector<PrimitiveObject> bindModel(tinygltf::Model &model);
+    std::vector<PrimitiveObject> bindModel(ModelAsset *asset);
+    void bindVertexAttributes(ModelAsset *asset);
+    void bindInstanceAttributes();
+    GLintptr instanceBlockOffset(RenderPass pass, GLuint level) const;
 
     // Draw functions
-    void drawMesh(const std::vector<PrimitiveObject> &primitiveObjects, tinygltf::Model &model, tinygltf::Mesh &mesh);
-    void drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects, tinygltf::Model &model, tinygltf::Node &node);
-    void drawModel(const std::vector<PrimitiveObject>& primitiveObjects, tinygltf::Model &model);
+    void drawMesh(const std::vector<PrimitiveObject> &primitiveObjects, int meshIndex);
+    void drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects, const ModelData &data, int nodeIndex);
+    void drawModel(const std::vector<PrimitiveObject>& primitiveObjects, const ModelData &data);
+    void drawLods(RenderPass pass);
+
+    // Transforms
+    void markInstancesDirty(GLuint first, GLuint count = 1);
+    bool updateModelMat();
 
     // helpers functions
-    void genModelMat(glm::vec3 position,glm::vec3 scale);
+    void genModelMat(glm::vec3 position,glm::vec3 scale, GLuint first = 0, GLuint end = 0);
     int findKeyframeIndex(const std::vector<float>& times, float animationTime);
 
     // Variables
@@ -130,21 +187,26 @@ struct gltfObj {
     GLfloat posMod = 1.0f;
     GLfloat scaleMod = 1.0f;
 
-    // Shader variable IDs
-    GLuint blockBindID;
-    GLuint mvpMatrixID;
-    GLuint jointMatricesID;
-    GLuint ubo_jointMatricesID;
-    GLuint lightPositionID;
-    GLuint lightIntensityID;
-
-    // Shader programs
-    GLuint programID;
-    GLuint depthProgramID;
-
-    // Shadow manipulations
-    GLuint lvpMatrixID;
-    GLuint depthTextureSamplerID;
+    // Shader handles, read once from the shaderManager reflection
+    const ObjUniforms *uniforms = NULL;
+    const ObjUniforms *depthUniforms = NULL;
+    const ObjUniforms *passUniforms = NULL;      // Those of the pass being drawn
+    GLuint jointMatricesBinding = 0;
+    GLuint jointMatricesID;                     // Our own when animated, the model's bind pose otherwise
+    bool jointMatricesDirty = false;            // update made a pose that is not uploaded yet
+
+    // Where the current pose is read from, the frame stream for animated objects
+    GLuint jointMatricesBuffer = 0;
+    GLintptr jointMatricesOffset = 0;
+    GLsizeiptr jointMatricesSize = 0;
+    unsigned long jointMatricesFrame = 0;
+
+    // Shader programs, variants of the object uber shader (see shaderManager)
+    GLuint shaderFeatures = 0;
+    GLuint depthShaderFeatures = 0;
+    bool programsBound = false;
+    GLuint programID = 0;
+    GLuint depthProgramID = 0;
 
     // Instanced
     GLuint instanced = 1; // Default value to one instance
@@ -155,26 +217,70 @@ struct gltfObj {
     GLfloat *scale_i;             // "" scale percentage from original scale
     GLfloat *rotationAngle_i;     // "" rotation angles offset
 
-    // Instance buffers data
-    GLuint i_modelMatBuffer;
-
-    // Material uniform handler idea
-    GLuint materialUniID;
-    GLuint metallicUniID;
-    GLuint roughnessUniID;
+    // Instance buffers data, each vao is this object's own view of the shared model buffers
+    GLuint i_modelMatBuffer;            // One block of "instanced" matrices per pass and level
+    GLuint instanceVAOs[passOpaque + 1][maxLods] = {};     // Each reads its block from the start
+
+    // Culling, the model's bounding sphere and one per instance
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    GLfloat boundsRadius = 0.0f;
+    SphereSet instanceSpheres;
+    std::vector<GLuint> visibleInstances;
+    std::vector<glm::mat4> visibleMat;
+
+    // What the blocks of each pass hold, the copy is skipped while it does not change
+    std::vector<GLuint> uploadedInstances[passOpaque + 1];
+    GLuint uploadedLods[passOpaque + 1][maxLods] = {};
+    unsigned long uploadedVersion[passOpaque + 1] = {};
+    unsigned long matricesVersion = 0;  // Bumped by updateModelMat when it rebuilt some
+
+    // The vao and how many instances the current draw has
+    GLuint drawVAO = 0;
+    GLuint drawCount = 1;
+
+    // Levels of detail, of the object or of each instance, and the one being drawn
+    GLuint lod = 0;
+    std::vector<unsigned char> instanceLods;
+    GLuint lodInstances[passOpaque + 1][maxLods] = {};
+    GLuint drawLod = 0;
+
+    // Scene BVH proxy, and the world box of every instance it is refit with
+    SceneBVH *bvh = NULL;
+    int bvhProxy = -1;
+    AABB worldBox;
+    bool worldBoxBuilt = false;
+
+    // Occlusion query proxy
+    OcclusionQueries *occlusion = NULL;
+    int occlusionProxy = -1;
+
+    // CPU occlusion the object is drawn in, NULL if it does not hide anything
+    SoftOcclusion *occluder = NULL;
+    int occluderIndex = -1;
+
+    // State modelMat was built with, and the instances to rebuild [dirtyFirst, dirtyEnd)
+    bool modelMatBuilt = false;
+    glm::vec3 builtPosition;
+    glm::vec3 builtScale;
+    glm::vec3 builtRotationAxis;
+    GLfloat builtRotationAngle;
+    GLuint dirtyFirst = 0;
+    GLuint dirtyEnd = 0;
+
+    // Static batch the object is drawn by, NULL if it draws itself
+    StaticBatch *batch = NULL;
+    int batchSlot = -1;
+
+    // Billboards used past the coarsest level of detail, NULL to keep the meshes
+    Impostor *impostor = NULL;
 
     // Texture handling
-    GLuint textureID;
-    GLuint textureSamplerID;
-    GLuint validTextureTestID;
-    GLfloat validTexture = 0.0f;
-
-    // Model related variables
-    tinygltf::Model model;
-    std::vector<PrimitiveObject> primitiveObjects;
+    TextureAsset *textureAsset = NULL;
+    GLuint textureID = 0;
+
+    // Model related variables, the asset is shared by every object using the same file
+    ModelAsset *modelAsset = NULL;
     std::vector<SkinObject> skinObjects;
-    std::vector<MaterialObject> materialObjects;
-    std::vector<AnimationObject> animationObjects;
 };
 
 
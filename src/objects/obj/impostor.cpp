@@ -0,0 +1,329 @@
+#include "impostor.h"
+#include "gltfObj.h"
+
+#include <render/shaderManager.h>
+#include <render/streamBuffer.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <iostream>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+void Impostor::add(gltfObj *member)
+{
+	members.push_back(member);
+}
+
+void Impostor::addInstance(RenderPass pass, const glm::mat4 &model)
+{
+	instances[pass].push_back(model);
+}
+
+// Orthographic view of the bounding sphere, same direction and up axis as impostor.vert picks
+void Impostor::renderView(gltfObj *source, GLuint shaderFeatures, int azimuth, int elevation)
+{
+	float azimuthAngle = azimuth * 2.0f * glm::pi<float>() / impostorAzimuths;
+	float elevationAngle = (elevation - (impostorElevations - 1) / 2) * glm::quarter_pi<float>();
+	glm::vec3 direction(cos(elevationAngle) * cos(azimuthAngle), sin(elevationAngle), cos(elevationAngle) * sin(azimuthAngle));
+
+	glm::mat4 view = glm::lookAt(boundsCenter + direction * 2.0f * boundsRadius, boundsCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::ortho(-boundsRadius, boundsRadius, -boundsRadius, boundsRadius, boundsRadius, 3.0f * boundsRadius);
+	glm::mat4 mvp = projection * view;
+
+	const ObjUniforms &uniforms = getObjUniforms(shaderFeatures);
+	glUseProgram(getObjProgram(shaderFeatures));
+	glUniformMatrix4fv(uniforms.mvp, 1, GL_FALSE, &mvp[0][0]);
+	if (uniforms.lightPosition >= 0)
+	{
+		glUniform3fv(uniforms.lightPosition, 1, &bakeLightPosition[0]);
+		glUniform3fv(uniforms.lightIntensity, 1, &bakeLightIntensity[0]);
+	}
+	if (uniforms.textureUnit >= 0)
+	{
+		glActiveTexture(GL_TEXTURE0 + uniforms.textureUnit);
+		glBindTexture(GL_TEXTURE_2D, source->textureID);
+	}
+	if (uniforms.jointMatrices)
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, getBlockBinding("jointMatrices"), source->modelAsset->bindPoseBuffer);
+	}
+
+	// Full mesh, one instance, from the model's own vao
+	source->passUniforms = &uniforms;
+	source->drawLod = 0;
+	source->drawCount = 1;
+	glBindVertexArray(source->modelAsset->vao);
+	const ModelData &data = source->modelAsset->data;
+	for (size_t i = 0; i < data.sceneNodes.size(); ++i)
+	{
+		source->drawModelNodes(source->modelAsset->primitiveObjects, data, data.sceneNodes[i]);
+	}
+}
+
+// The obj shaders leave the alpha undefined, it is replaced by 1 where the bake wrote a depth, 0 elsewhere
+bool Impostor::writeCoverage(GLsizei width, GLsizei height)
+{
+	GLuint coverageProgram = getProgram(impostorCoverageVertexPath, impostorCoverageFragmentPath);
+	if (coverageProgram == 0)
+	{
+		std::cerr << "Failed to load impostor coverage shaders." << std::endl;
+		return false;
+	}
+
+	// One triangle over the whole atlas made from gl_VertexID, the vao has no attribute
+	GLuint emptyVAO;
+	glGenVertexArrays(1, &emptyVAO);
+	glBindVertexArray(emptyVAO);
+
+	glUseProgram(coverageProgram);
+	glActiveTexture(GL_TEXTURE0 + getProgramReflection(coverageProgram).samplerUnit("depthAtlas"));
+	glBindTexture(GL_TEXTURE_2D, depthAtlas);
+
+	glViewport(0, 0, width, height);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE);
+	glDisable(GL_DEPTH_TEST);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &emptyVAO);
+	return true;
+}
+
+// Render every view of the model in its cell, then set up the quad the instances are drawn with
+void Impostor::bake(glm::vec3 lightPosition, glm::vec3 lightIntensity)
+{
+	if (baked)
+	{
+		return;
+	}
+
+	// The atlas holds the bind pose, animated members draw themselves
+	gltfObj *source = NULL;
+	for (size_t i = 0; i < members.size(); i++)
+	{
+		gltfObj *member = members[i];
+		if (member->modelAsset == NULL || !member->modelAsset->committed || member->animationON)
+		{
+			member->impostor = NULL;
+		}
+		else if (source == NULL)
+		{
+			source = member;
+		}
+	}
+	if (source == NULL)
+	{
+		return;
+	}
+
+	boundsCenter = source->boundsCenter;
+	boundsRadius = source->boundsRadius;
+	bakeLightPosition = lightPosition;
+	bakeLightIntensity = lightIntensity;
+
+	// Shading only, the instances and the received shadows are not part of the views
+	GLuint shaderFeatures = source->shaderFeatures & (obj_l | obj_tex | obj_a);
+	queueObjProgram(shaderFeatures);
+
+	GLsizei width = impostorAzimuths * impostorCellSize;
+	GLsizei height = impostorElevations * impostorCellSize;
+
+	glGenTextures(1, &colorAtlas);
+	glBindTexture(GL_TEXTURE_2D, colorAtlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// The cells touch, past this level a texel would average two views together
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, impostorMaxMipLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &depthAtlas);
+	glBindTexture(GL_TEXTURE_2D, depthAtlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorAtlas, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthAtlas, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cerr << "Impostor framebuffer is not complete." << std::endl;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, width, height);
+
+	// Transparent black outside the model, the color stays premultiplied by the coverage
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	for (int elevation = 0; elevation < impostorElevations; elevation++)
+	{
+		for (int azimuth = 0; azimuth < impostorAzimuths; azimuth++)
+		{
+			glViewport(azimuth * impostorCellSize, elevation * impostorCellSize, impostorCellSize, impostorCellSize);
+			renderView(source, shaderFeatures, azimuth, elevation);
+		}
+	}
+
+	// The depth is sampled next, it cannot stay attached
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+	bool covered = writeCoverage(width, height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &depthAtlas);
+	depthAtlas = 0;
+	if (!covered)
+	{
+		return;
+	}
+
+	// Averaging the premultiplied color with its coverage keeps the edges from darkening
+	glBindTexture(GL_TEXTURE_2D, colorAtlas);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	// Unit quad as a strip, the instance matrices are pointed at once submit wrote them
+	const GLfloat corners[8] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(1, &quadBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	for (int i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(5 + i);
+		glVertexAttribDivisor(5 + i, 1);
+	}
+	glBindVertexArray(0);
+
+	programID = getProgram(impostorVertexPath, impostorFragmentPath);
+	if (programID == 0)
+	{
+		std::cerr << "Failed to load impostor shaders." << std::endl;
+		return;
+	}
+	const ProgramReflection &reflection = getProgramReflection(programID);
+	vpID = reflection.uniform("VP");
+	viewerID = reflection.uniform("viewer");
+	boundsID = reflection.uniform("bounds");
+	colorUnit = reflection.samplerUnit("colorAtlas");
+
+	baked = true;
+}
+
+// Queue callback, packets point at their impostor
+static void drawImpostor(void *object, RenderPass pass, const FrameContext &context)
+{
+	static_cast<Impostor *>(object)->draw(pass, context);
+}
+
+// Write the instances the members handed over, one packet per pass, then forget them for the next frame
+void Impostor::submit(RenderQueue &queue, const FrameContext &context)
+{
+	for (int pass = 0; pass <= passOpaque; pass++)
+	{
+		drawCount[pass] = instances[pass].size();
+		if (!baked || instances[pass].empty())
+		{
+			instances[pass].clear();
+			continue;
+		}
+
+		GLsizeiptr size = instances[pass].size() * sizeof(glm::mat4);
+		if (frameStream.write(instances[pass].data(), size, drawOffset[pass]))
+		{
+			drawBuffer[pass] = frameStream.buffer;
+		}
+		else
+		{
+			if (instanceBuffers[pass] == 0)
+			{
+				glGenBuffers(1, &instanceBuffers[pass]);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffers[pass]);
+			glBufferData(GL_ARRAY_BUFFER, size, instances[pass].data(), GL_STREAM_DRAW);
+			drawBuffer[pass] = instanceBuffers[pass];
+			drawOffset[pass] = 0;
+		}
+
+		// One quad per instance, the distance part of the key does not mean anything here
+		queue.submit(makeSortKey((RenderPass)pass, programID, colorAtlas, vao, 0.0f), this, drawImpostor);
+		if (pass == passOpaque && context.depthPrepass)
+		{
+			queue.submit(makeSortKey(passPrepass, programID, colorAtlas, vao, 0.0f), this, drawImpostor);
+		}
+		instances[pass].clear();
+	}
+}
+
+// The depth pass uses the same quads, facing the light, so the far objects still cast their shadow
+void Impostor::draw(RenderPass pass, const FrameContext &context)
+{
+	bool depth = (pass == passDepth);
+	glm::mat4 viewProjection = depth ? context.lightMatrix : context.cameraMatrix;
+	glm::vec3 viewer = depth ? context.lightPosition : context.eye;
+
+	// The pre-pass draws the opaque instances, the color writes are off
+	if (pass == passPrepass)
+	{
+		pass = passOpaque;
+	}
+
+	glUseProgram(programID);
+	glUniformMatrix4fv(vpID, 1, GL_FALSE, &viewProjection[0][0]);
+	glUniform3fv(viewerID, 1, &viewer[0]);
+	glUniform4f(boundsID, boundsCenter.x, boundsCenter.y, boundsCenter.z, boundsRadius);
+
+	glActiveTexture(GL_TEXTURE0 + colorUnit);
+	glBindTexture(GL_TEXTURE_2D, colorAtlas);
+
+	std::size_t rowSize = sizeof(glm::vec4);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, drawBuffer[pass]);
+	for (int i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, BUFFER_OFFSET(drawOffset[pass] + i * rowSize));
+	}
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, drawCount[pass]);
+}
+
+void Impostor::cleanup()
+{
+	// Names left at 0 are ignored, a bake that failed half way is cleaned too
+	glDeleteTextures(1, &colorAtlas);
+	glDeleteTextures(1, &depthAtlas);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &quadBuffer);
+	colorAtlas = depthAtlas = vao = quadBuffer = 0;
+	for (int pass = 0; pass <= passOpaque; pass++)
+	{
+		if (instanceBuffers[pass] != 0)
+		{
+			glDeleteBuffers(1, &instanceBuffers[pass]);
+			instanceBuffers[pass] = 0;
+		}
+		instances[pass].clear();
+	}
+	members.clear();
+	baked = false;
+}
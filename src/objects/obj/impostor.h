@@ -0,0 +1,97 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include <render/renderQueue.h>
+
+#include "../commonStructs.h"
+
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Billboard stand-in for the gltfObj of one model once they   //
+//  are too small on screen for their meshes to matter. The model   //
+//  is rendered once from a ring of view directions around its      //
+//  up axis (at three elevations) into an atlas, each far instance  //
+//  is then one camera facing quad reading the view closest to the  //
+//  direction it is seen from. All of them are one instanced draw.  //
+//  The objects shade in model space with a light that never moves,//
+//  so the baked colors are the ones the meshes would have, only    //
+//  the received shadows are missing.                               //
+//																	//
+//      add : Done by gltfObj::init_imp, every member uses the same //
+//          model (the first one is the one rendered).              //
+//      bake : Once the members are committed, renders the atlas.   //
+//          Animated members keep their meshes. The coverage goes   //
+//          in the alpha before the mips are built, the quads then  //
+//          discard on it at every distance.                        //
+//      addInstance : Done by the members (and the StaticBatch)     //
+//          for every instance whose level of detail went past the  //
+//          coarsest mesh (impostorLod).                            //
+//      submit : Queues one draw per pass, after the members and    //
+//          the batch were submitted. The depth pre-pass draws the  //
+//          opaque quads, the atlas coverage still discards.        //
+//																	//
+//------------------------------------------------------------------//
+
+struct gltfObj;
+
+// Views of the atlas, around the up axis and from below to above
+const int impostorAzimuths = 8;
+const int impostorElevations = 3;
+const int impostorCellSize = 128;
+const int impostorMaxMipLevel = 5;      // log2(impostorCellSize) - 2, cells are still 4 texels wide there
+
+const char *const impostorVertexPath = "../src/shaders/impostor.vert";
+const char *const impostorFragmentPath = "../src/shaders/impostor.frag";
+const char *const impostorCoverageVertexPath = "../src/shaders/impostorCoverage.vert";
+const char *const impostorCoverageFragmentPath = "../src/shaders/impostorCoverage.frag";
+
+struct Impostor {
+
+    void add(gltfObj *member);
+    void bake(glm::vec3 lightPosition, glm::vec3 lightIntensity);
+    void addInstance(RenderPass pass, const glm::mat4 &model);
+    void submit(RenderQueue &queue, const FrameContext &context);
+    void draw(RenderPass pass, const FrameContext &context);
+    void cleanup();
+
+    // Baking
+    void renderView(gltfObj *source, GLuint shaderFeatures, int azimuth, int elevation);
+    bool writeCoverage(GLsizei width, GLsizei height);
+
+    std::vector<gltfObj *> members;
+
+    // Model space sphere the views are framed on
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    GLfloat boundsRadius = 0.0f;
+
+    // Atlas, premultiplied by the coverage in its alpha so the mips keep the silhouettes
+    GLuint colorAtlas = 0;
+    GLuint depthAtlas = 0;              // Only while baking, the coverage is read from it
+    glm::vec3 bakeLightPosition;
+    glm::vec3 bakeLightIntensity;
+
+    // Quad and the instance matrices of each pass
+    GLuint vao = 0;
+    GLuint quadBuffer = 0;
+    GLuint instanceBuffers[passOpaque + 1] = {};      // Used when the frame stream is full
+    std::vector<glm::mat4> instances[passOpaque + 1];
+    GLuint drawCount[passOpaque + 1] = {};
+    GLuint drawBuffer[passOpaque + 1] = {};
+    GLintptr drawOffset[passOpaque + 1] = {};
+
+    // Program
+    GLuint programID = 0;
+    GLint vpID = -1;
+    GLint viewerID = -1;
+    GLint boundsID = -1;
+    GLint colorUnit = -1;
+
+    bool baked = false;
+};
+
+#endif //IMPOSTOR_H
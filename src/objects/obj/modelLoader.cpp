@@ -0,0 +1,855 @@
+#include <tiny_gltf.h>
+#include "modelLoader.h"
+
+#include <render/meshOptimizer.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Baked file identification, bump the version when the layout changes
+static const char bakedMagic[4] = {'B', 'M', 'S', 'H'};
+static const uint32_t bakedVersion = 4;
+static const uint32_t bakedAlignment = 16;
+
+// Channel paths are stored as numbers in baked files
+static const char *channelPaths[3] = {"translation", "rotation", "scale"};
+
+//---- Shared helpers ----
+
+// Get node transforms from node
+static glm::mat4 getNodeTransform(const tinygltf::Node& node) {
+	glm::mat4 transform(1.0f);
+
+	if (node.matrix.size() == 16) {
+		transform = glm::make_mat4(node.matrix.data());
+	} else {
+		if (node.translation.size() == 3) {
+			transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+		}
+		if (node.rotation.size() == 4) {
+			glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+			transform *= glm::mat4_cast(q);
+		}
+		if (node.scale.size() == 3) {
+			transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+		}
+	}
+	return transform;
+}
+
+// Compute global transforms and fill it with the node transforms
+void computeGlobalNodeTransform(const ModelData &data,
+	const std::vector<glm::mat4> &localTransforms,
+	int nodeIndex, const glm::mat4 &parentTransform,
+	std::vector<glm::mat4> &globalTransforms)
+{
+	globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
+
+	for (size_t i = 0; i < data.nodes[nodeIndex].children.size(); i++) {
+		computeGlobalNodeTransform(data, localTransforms, data.nodes[nodeIndex].children[i], globalTransforms[nodeIndex], globalTransforms);
+	}
+}
+
+// Fill the joint matrices of every skin with the rest pose of the nodes
+static void computeBindPose(ModelData &data)
+{
+	std::vector<glm::mat4> localNodeTransforms(data.nodes.size());
+	for (size_t i = 0; i < data.nodes.size(); i++) {
+		localNodeTransforms[i] = data.nodes[i].transform;
+	}
+
+	for (size_t i = 0; i < data.skins.size(); i++) {
+		SkinObject &skinObject = data.skins[i];
+
+		skinObject.globalJointTransforms.resize(data.nodes.size());
+		skinObject.jointMatrices.resize(skinObject.joints.size());
+
+		// Compute the global node transforms from the root node
+		computeGlobalNodeTransform(data, localNodeTransforms, skinObject.joints[0], glm::mat4(1.0f),
+			skinObject.globalJointTransforms);
+
+		// Calculate the joint matrices
+		for (size_t h = 0; h < skinObject.jointMatrices.size(); h++)
+		{
+			int nodeIndex = skinObject.joints[h];
+			skinObject.jointMatrices[h] = skinObject.globalJointTransforms[nodeIndex] * skinObject.inverseBindMatrices[h];
+		}
+	}
+}
+
+std::string bakedModelPath(const char *filename)
+{
+	std::string path(filename);
+	size_t dot = path.find_last_of('.');
+	if (dot != std::string::npos && path.find_first_of("/\\", dot) == std::string::npos) {
+		path.erase(dot);
+	}
+	return path + ".bmesh";
+}
+
+bool loadModelData(const char *filename, ModelData &data, bool optimize)
+{
+	std::string path(filename);
+	if (path.size() > 6 && path.compare(path.size() - 6, 6, ".bmesh") == 0) {
+		return loadBakedModel(filename, data);
+	}
+
+	// Only use the baked file if it is at least as recent as the source
+	std::string bakedPath = bakedModelPath(filename);
+	if (isBakeUpToDate(bakedPath.c_str(), filename))
+	{
+		if (loadBakedModel(bakedPath.c_str(), data)) {
+			return true;
+		}
+		std::cout << "WARN: Ignoring baked model " << bakedPath << std::endl;
+	}
+
+	return loadGLTFModel(filename, data, optimize);
+}
+
+// Narrow the indices to 16 bits when every primitive allows it, they are relative to the primitive's base vertex
+static void storeIndices(const std::vector<uint32_t> &indices, ModelData &data)
+{
+	data.indexType = GL_UNSIGNED_SHORT;
+	for (size_t m = 0; m < data.meshes.size(); ++m) {
+		for (size_t i = 0; i < data.meshes[m].primitives.size(); ++i) {
+			if (data.meshes[m].primitives[i].vertexCount > 65536) {
+				data.indexType = GL_UNSIGNED_INT;
+			}
+		}
+	}
+
+	if (data.indexType == GL_UNSIGNED_INT) {
+		data.indexStorage.resize(indices.size() * sizeof(uint32_t));
+		memcpy(data.indexStorage.data(), indices.data(), data.indexStorage.size());
+	} else {
+		data.indexStorage.resize(indices.size() * sizeof(uint16_t));
+		uint16_t *narrow = reinterpret_cast<uint16_t *>(data.indexStorage.data());
+		for (size_t i = 0; i < indices.size(); ++i) {
+			narrow[i] = (uint16_t)indices[i];
+		}
+	}
+
+	data.vertices = data.vertexStorage.data();
+	data.vertexCount = data.vertexStorage.size();
+	data.indices = data.indexStorage.data();
+	data.indexCount = indices.size();
+}
+
+//---- GLTF ----
+
+// Get material from model and push it to the materials vector
+static void extractMaterials(const tinygltf::Model &model, ModelData &data)
+{
+	for (size_t i=0; i< model.materials.size();i++)
+	{
+		const tinygltf::Material &fetchedmaterial = model.materials[i];
+		MaterialObject material;
+		material.BaseColorFactor = glm::vec4(1.0f);
+		// Fixed to 4 as it is RGBa
+		for (size_t j =0; j < 4; j++)
+		{
+			material.BaseColorFactor[j] = fetchedmaterial.pbrMetallicRoughness.baseColorFactor[j];
+		}
+		material.MetallicFactor = fetchedmaterial.pbrMetallicRoughness.metallicFactor;
+		material.RoughnessFactor = fetchedmaterial.pbrMetallicRoughness.roughnessFactor;
+
+		data.materials.push_back(material);
+	}
+}
+
+// Read any float or integer accessor as vec4s, normalized integers are mapped to [0,1]
+static std::vector<glm::vec4> readAccessor(const tinygltf::Model &model, int accessorIndex)
+{
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const unsigned char *ptr = model.buffers[bufferView.buffer].data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+	int stride = accessor.ByteStride(bufferView);
+	int components = (accessor.type != TINYGLTF_TYPE_SCALAR) ? accessor.type : 1;
+
+	std::vector<glm::vec4> values(accessor.count, glm::vec4(0.0f));
+	for (size_t i = 0; i < accessor.count; ++i) {
+		const unsigned char *element = ptr + i * stride;
+		for (int c = 0; c < components && c < 4; ++c) {
+			float value = 0.0f;
+			switch (accessor.componentType) {
+				case TINYGLTF_COMPONENT_TYPE_FLOAT:
+					memcpy(&value, element + c * sizeof(float), sizeof(float));
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+					value = element[c];
+					if (accessor.normalized) value /= 255.0f;
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+					uint16_t raw;
+					memcpy(&raw, element + c * sizeof(raw), sizeof(raw));
+					value = accessor.normalized ? raw / 65535.0f : raw;
+					break;
+				}
+				default:
+					std::cout << "Unsupported component type " << accessor.componentType << std::endl;
+					break;
+			}
+			values[i][c] = value;
+		}
+	}
+	return values;
+}
+
+static std::vector<uint32_t> readIndices(const tinygltf::Model &model, int accessorIndex)
+{
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const unsigned char *ptr = model.buffers[bufferView.buffer].data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+	int size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+	int stride = accessor.ByteStride(bufferView);
+
+	std::vector<uint32_t> indices(accessor.count, 0);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		memcpy(&indices[i], ptr + i * stride, size);	// Little endian, the smaller types land in the low bytes
+	}
+	return indices;
+}
+
+// Repack every primitive in the interleaved layout, appended to one vertex and one index array
+static void extractMeshes(const tinygltf::Model &model, ModelData &data, bool optimize)
+{
+	std::vector<uint32_t> indices;
+	bool hasBounds = false;
+
+	for (size_t m = 0; m < model.meshes.size(); ++m) {
+		MeshData meshData;
+
+		// Cache misses of the whole mesh, for the report
+		float missesBefore = 0.0f, missesAfter = 0.0f;
+		size_t triangleCount = 0;
+
+		for (size_t i = 0; i < model.meshes[m].primitives.size(); ++i) {
+			const tinygltf::Primitive &primitive = model.meshes[m].primitives[i];
+
+			std::map<std::string, int>::const_iterator position = primitive.attributes.find("POSITION");
+			if (position == primitive.attributes.end()) {
+				std::cout << "Primitive without positions skipped" << std::endl;
+				continue;
+			}
+			std::vector<glm::vec4> positions = readAccessor(model, position->second);
+
+			// The accessor min/max are mandatory for positions, computed from the data for exporters that skip them
+			const tinygltf::Accessor &positionAccessor = model.accessors[position->second];
+			glm::vec3 primitiveMin, primitiveMax;
+			if (positionAccessor.minValues.size() >= 3 && positionAccessor.maxValues.size() >= 3) {
+				primitiveMin = glm::vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]);
+				primitiveMax = glm::vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2]);
+			} else if (!positions.empty()) {
+				primitiveMin = primitiveMax = glm::vec3(positions[0]);
+				for (size_t v = 1; v < positions.size(); ++v) {
+					primitiveMin = glm::min(primitiveMin, glm::vec3(positions[v]));
+					primitiveMax = glm::max(primitiveMax, glm::vec3(positions[v]));
+				}
+			} else {
+				continue;
+			}
+			data.boundsMin = hasBounds ? glm::min(data.boundsMin, primitiveMin) : primitiveMin;
+			data.boundsMax = hasBounds ? glm::max(data.boundsMax, primitiveMax) : primitiveMax;
+			hasBounds = true;
+			std::vector<glm::vec4> normals, uvs, joints, weights;
+
+			for (std::map<std::string, int>::const_iterator it = primitive.attributes.begin(); it != primitive.attributes.end(); ++it) {
+				if (it->first.compare("POSITION") == 0) continue;
+				else if (it->first.compare("NORMAL") == 0) normals = readAccessor(model, it->second);
+				else if (it->first.compare("TEXCOORD_0") == 0) uvs = readAccessor(model, it->second);
+				else if (it->first.compare("JOINTS_0") == 0) joints = readAccessor(model, it->second);
+				else if (it->first.compare("WEIGHTS_0") == 0) weights = readAccessor(model, it->second);
+				else std::cout << "vaa missing: " << it->first << std::endl;
+			}
+
+			// Missing attributes are left to zero (glm vectors start zeroed), as the disabled vertex arrays were
+			std::vector<Vertex> vertices(positions.size());
+			for (size_t v = 0; v < positions.size(); ++v) {
+				Vertex &vertex = vertices[v];
+				vertex.position = glm::vec3(positions[v]);
+				if (v < normals.size()) vertex.normal = glm::vec3(normals[v]);
+				if (v < uvs.size()) vertex.uv = glm::vec2(uvs[v]);
+				for (int c = 0; c < 4; ++c) {
+					vertex.joints[c] = (v < joints.size()) ? (GLushort)joints[v][c] : 0;
+				}
+				if (v < weights.size()) vertex.weights = weights[v];
+			}
+
+			// Non indexed primitives get a trivial index list
+			std::vector<uint32_t> primitiveIndices;
+			if (primitive.indices >= 0) {
+				primitiveIndices = readIndices(model, primitive.indices);
+			} else {
+				for (uint32_t v = 0; v < positions.size(); ++v) {
+					primitiveIndices.push_back(v);
+				}
+			}
+
+			// Only triangle lists can be reordered
+			if (optimize && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				missesBefore += computeACMR(primitiveIndices, vertices.size()) * (primitiveIndices.size() / 3);
+				optimizeMesh(vertices, primitiveIndices);
+				missesAfter += computeACMR(primitiveIndices, vertices.size()) * (primitiveIndices.size() / 3);
+				triangleCount += primitiveIndices.size() / 3;
+			}
+
+			PrimitiveData primitiveData;
+			primitiveData.mode = primitive.mode;
+			primitiveData.material = primitive.material;
+			primitiveData.baseVertex = data.vertexStorage.size();
+			primitiveData.vertexCount = vertices.size();
+			primitiveData.firstIndex = indices.size();
+			primitiveData.indexCount = primitiveIndices.size();
+			primitiveData.lodCount = 1;
+			primitiveData.lodFirstIndex[0] = primitiveData.firstIndex;
+			primitiveData.lodIndexCount[0] = primitiveData.indexCount;
+
+			data.vertexStorage.insert(data.vertexStorage.end(), vertices.begin(), vertices.end());
+			indices.insert(indices.end(), primitiveIndices.begin(), primitiveIndices.end());
+
+			// Each level aims at half the triangles of the previous one, on the same vertices
+			if (optimize && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				std::vector<uint32_t> lodIndices = primitiveIndices;
+				for (int level = 1; level < maxLods; ++level) {
+					size_t target = (primitiveIndices.size() >> level) / 3 * 3;
+					std::vector<uint32_t> simplified = simplifyMesh(vertices, lodIndices, target);
+
+					// Not worth a level if the simplifier got stuck
+					if (simplified.empty() || simplified.size() * 10 > lodIndices.size() * 9) {
+						break;
+					}
+					optimizeVertexCache(simplified, vertices.size());
+
+					primitiveData.lodFirstIndex[level] = indices.size();
+					primitiveData.lodIndexCount[level] = simplified.size();
+					primitiveData.lodCount++;
+					indices.insert(indices.end(), simplified.begin(), simplified.end());
+					lodIndices.swap(simplified);
+				}
+			}
+
+			meshData.primitives.push_back(primitiveData);
+		}
+		data.meshes.push_back(meshData);
+
+		if (triangleCount > 0) {
+			std::cout << "Mesh " << m << " (" << model.meshes[m].name << ") ACMR: " << missesBefore / triangleCount
+				<< " -> " << missesAfter / triangleCount << std::endl;
+		}
+	}
+
+	storeIndices(indices, data);
+}
+
+static void extractNodes(const tinygltf::Model &model, ModelData &data)
+{
+	for (size_t i = 0; i < model.nodes.size(); ++i) {
+		NodeData node;
+		node.transform = getNodeTransform(model.nodes[i]);
+		node.mesh = model.nodes[i].mesh;
+		node.children = model.nodes[i].children;
+		data.nodes.push_back(node);
+	}
+
+	if (!model.scenes.empty()) {
+		data.sceneNodes = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0].nodes;
+	}
+}
+
+// Create the skin objects, in our Blender exporter the default number of joints that may influence a vertex is set to 4
+static void extractSkins(const tinygltf::Model &model, ModelData &data)
+{
+	for (size_t i = 0; i < model.skins.size(); i++) {
+		SkinObject skinObject;
+
+		const tinygltf::Skin &skin = model.skins[i];
+		skinObject.joints = skin.joints;
+
+		// Read inverseBindMatrices
+		const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
+		assert(accessor.type == TINYGLTF_TYPE_MAT4);
+		const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+		const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+		const float *ptr = reinterpret_cast<const float *>(
+            buffer.data.data() + accessor.byteOffset + bufferView.byteOffset);
+
+		skinObject.inverseBindMatrices.resize(accessor.count);
+		for (size_t j = 0; j < accessor.count; j++) {
+			float m[16];
+			memcpy(m, ptr + j * 16, 16 * sizeof(float));
+			skinObject.inverseBindMatrices[j] = glm::make_mat4(m);
+		}
+
+		assert(skin.joints.size() == accessor.count);
+
+		data.skins.push_back(skinObject);
+	}
+}
+
+static void extractAnimations(const tinygltf::Model &model, ModelData &data)
+{
+	for (const auto &anim : model.animations) {
+		AnimationObject animationObject;
+
+		for (const auto &sampler : anim.samplers) {
+			SamplerObject samplerObject;
+			samplerObject.interpolation = (sampler.interpolation == "STEP") ? 1 : 0;
+
+			const tinygltf::Accessor &inputAccessor = model.accessors[sampler.input];
+			const tinygltf::BufferView &inputBufferView = model.bufferViews[inputAccessor.bufferView];
+			const tinygltf::Buffer &inputBuffer = model.buffers[inputBufferView.buffer];
+
+			assert(inputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+			assert(inputAccessor.type == TINYGLTF_TYPE_SCALAR);
+
+			// Input (time) values
+			samplerObject.input.resize(inputAccessor.count);
+
+			const unsigned char *inputPtr = &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset];
+
+			// Read input (time) values
+			int stride = inputAccessor.ByteStride(inputBufferView);
+			for (size_t i = 0; i < inputAccessor.count; ++i) {
+				samplerObject.input[i] = *reinterpret_cast<const float*>(inputPtr + i * stride);
+			}
+
+			const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
+			const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
+			const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
+
+			assert(outputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+
+			const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
+
+			// Output values
+			samplerObject.output.resize(outputAccessor.count, glm::vec4(0.0f));
+
+			for (size_t i = 0; i < outputAccessor.count; ++i) {
+
+				if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
+					memcpy(&samplerObject.output[i], outputPtr + i * 3 * sizeof(float), 3 * sizeof(float));
+				} else if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
+					memcpy(&samplerObject.output[i], outputPtr + i * 4 * sizeof(float), 4 * sizeof(float));
+				} else {
+					std::cout << "Unsupport accessor type ..." << std::endl;
+				}
+
+			}
+
+			animationObject.samplers.push_back(samplerObject);
+		}
+
+		for (const auto &channel : anim.channels) {
+			ChannelObject channelObject;
+			channelObject.sampler = channel.sampler;
+			channelObject.targetPath = channel.target_path;
+			channelObject.targetNode = channel.target_node;
+			animationObject.channels.push_back(channelObject);
+		}
+
+		data.animations.push_back(animationObject);
+	}
+}
+
+// Images are decoded by the texture cache, tinygltf only has to keep their uri
+static bool skipImage(tinygltf::Image *, const int, std::string *, std::string *, int, int, const unsigned char *, int, void *)
+{
+	return true;
+}
+
+bool loadGLTFModel(const char *filename, ModelData &data, bool optimize)
+{
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err;
+	std::string warn;
+
+	// Images are left to the texture cache
+	loader.SetImageLoader(&skipImage, NULL);
+
+	// The buffers are copied by tinygltf and repacked, mapping the file would only save a read (the baked files are the mapped ones)
+	std::string path(filename);
+	bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+
+	bool res = false;
+	if (binary) {
+		res = loader.LoadBinaryFromFile(&model, &err, &warn, filename);
+	} else {
+		res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+	}
+
+	if (!warn.empty()) {
+		std::cout << "WARN: " << warn << std::endl;
+	}
+
+	if (!err.empty()) {
+		std::cout << "ERR: " << err << std::endl;
+	}
+
+	if (!res) {
+		std::cout << "Failed to load glTF: " << filename << std::endl;
+		return false;
+	}
+	std::cout << "Loaded glTF: " << filename << std::endl;
+
+	extractMaterials(model, data);
+	extractMeshes(model, data, optimize);
+	extractNodes(model, data);
+	extractSkins(model, data);
+	extractAnimations(model, data);
+	computeBindPose(data);
+
+	return true;
+}
+
+void releaseModelBuffers(ModelData &data)
+{
+	data.vertices = NULL;
+	data.indices = NULL;
+	std::vector<Vertex>().swap(data.vertexStorage);
+	std::vector<unsigned char>().swap(data.indexStorage);
+	data.mapping.close();
+}
+
+//---- Baked files ----
+
+// Appends values to the file content
+struct BakedWriter {
+	std::vector<unsigned char> bytes;
+
+	void write(const void *value, size_t size) {
+		const unsigned char *ptr = static_cast<const unsigned char *>(value);
+		bytes.insert(bytes.end(), ptr, ptr + size);
+	}
+	void writeU32(uint32_t value) { write(&value, sizeof(value)); }
+	void writeI32(int32_t value) { write(&value, sizeof(value)); }
+	void writeF32(float value) { write(&value, sizeof(value)); }
+	void align() { bytes.resize((bytes.size() + bakedAlignment - 1) / bakedAlignment * bakedAlignment, 0); }
+};
+
+// Reads values from the mapped file, any read past the end marks the file as invalid
+struct BakedReader {
+	const unsigned char *data;
+	size_t size;
+	size_t cursor;
+	bool valid;
+
+	const unsigned char *read(size_t count) {
+		if (!valid || count > size - cursor) {
+			valid = false;
+			return NULL;
+		}
+		const unsigned char *ptr = data + cursor;
+		cursor += count;
+		return ptr;
+	}
+	void read(void *value, size_t count) {
+		const unsigned char *ptr = read(count);
+		if (ptr != NULL) {
+			memcpy(value, ptr, count);
+		} else {
+			memset(value, 0, count);
+		}
+	}
+	uint32_t readU32() { uint32_t value; read(&value, sizeof(value)); return value; }
+	int32_t readI32() { int32_t value; read(&value, sizeof(value)); return value; }
+	float readF32() { float value; read(&value, sizeof(value)); return value; }
+	// Counts are checked against what is left so a corrupted file cannot ask for huge allocations
+	uint32_t readCount(size_t minElementSize) {
+		uint32_t count = readU32();
+		if (valid && (size_t)count * minElementSize > size - cursor) {
+			valid = false;
+		}
+		return valid ? count : 0;
+	}
+};
+
+bool writeBakedModel(const char *filename, const ModelData &data)
+{
+	BakedWriter writer;
+	writer.write(bakedMagic, sizeof(bakedMagic));
+	writer.writeU32(bakedVersion);
+
+	// Blobs are stored after the tables, the offsets are patched once they are known
+	size_t indexSize = (data.indexType == GL_UNSIGNED_INT) ? sizeof(uint32_t) : sizeof(uint16_t);
+	writer.writeU32(data.vertexCount);
+	writer.writeU32(data.indexCount);
+	writer.writeU32(data.indexType);
+	size_t blobOffsetPosition = writer.bytes.size();
+	writer.writeU32(0);
+	writer.writeU32(0);
+	writer.write(&data.boundsMin[0], 3 * sizeof(float));
+	writer.write(&data.boundsMax[0], 3 * sizeof(float));
+
+	writer.writeU32(data.materials.size());
+	for (size_t i = 0; i < data.materials.size(); i++) {
+		writer.write(&data.materials[i].BaseColorFactor[0], 4 * sizeof(float));
+		writer.writeF32(data.materials[i].MetallicFactor);
+		writer.writeF32(data.materials[i].RoughnessFactor);
+	}
+
+	writer.writeU32(data.meshes.size());
+	for (size_t m = 0; m < data.meshes.size(); m++) {
+		const MeshData &mesh = data.meshes[m];
+		writer.writeU32(mesh.primitives.size());
+		for (size_t i = 0; i < mesh.primitives.size(); i++) {
+			const PrimitiveData &primitive = mesh.primitives[i];
+			writer.writeU32(primitive.mode);
+			writer.writeI32(primitive.material);
+			writer.writeU32(primitive.indexCount);
+			writer.writeU32(primitive.firstIndex);
+			writer.writeI32(primitive.baseVertex);
+			writer.writeU32(primitive.vertexCount);
+			writer.writeU32(primitive.lodCount);
+			for (GLuint l = 1; l < primitive.lodCount; l++) {
+				writer.writeU32(primitive.lodFirstIndex[l]);
+				writer.writeU32(primitive.lodIndexCount[l]);
+			}
+		}
+	}
+
+	writer.writeU32(data.nodes.size());
+	for (size_t i = 0; i < data.nodes.size(); i++) {
+		writer.write(&data.nodes[i].transform[0][0], 16 * sizeof(float));
+		writer.writeI32(data.nodes[i].mesh);
+		writer.writeU32(data.nodes[i].children.size());
+		for (size_t c = 0; c < data.nodes[i].children.size(); c++) {
+			writer.writeI32(data.nodes[i].children[c]);
+		}
+	}
+
+	writer.writeU32(data.sceneNodes.size());
+	for (size_t i = 0; i < data.sceneNodes.size(); i++) {
+		writer.writeI32(data.sceneNodes[i]);
+	}
+
+	writer.writeU32(data.skins.size());
+	for (size_t i = 0; i < data.skins.size(); i++) {
+		const SkinObject &skin = data.skins[i];
+		writer.writeU32(skin.joints.size());
+		for (size_t j = 0; j < skin.joints.size(); j++) {
+			writer.writeI32(skin.joints[j]);
+			writer.write(&skin.inverseBindMatrices[j][0][0], 16 * sizeof(float));
+		}
+	}
+
+	writer.writeU32(data.animations.size());
+	for (size_t i = 0; i < data.animations.size(); i++) {
+		const AnimationObject &animation = data.animations[i];
+		writer.writeU32(animation.samplers.size());
+		for (size_t s = 0; s < animation.samplers.size(); s++) {
+			const SamplerObject &sampler = animation.samplers[s];
+			writer.writeI32(sampler.interpolation);
+			writer.writeU32(sampler.input.size());
+			writer.write(sampler.input.data(), sampler.input.size() * sizeof(float));
+			writer.writeU32(sampler.output.size());
+			writer.write(sampler.output.data(), sampler.output.size() * sizeof(glm::vec4));
+		}
+		writer.writeU32(animation.channels.size());
+		for (size_t c = 0; c < animation.channels.size(); c++) {
+			const ChannelObject &channel = animation.channels[c];
+			uint32_t path = 0;
+			while (path < 2 && channel.targetPath != channelPaths[path]) {
+				path++;
+			}
+			writer.writeI32(channel.sampler);
+			writer.writeI32(channel.targetNode);
+			writer.writeU32(path);
+		}
+	}
+
+	// GPU ready blobs, aligned so they can be handed to glBufferData as is
+	uint32_t blobOffsets[2];
+	writer.align();
+	blobOffsets[0] = writer.bytes.size();
+	writer.write(data.vertices, data.vertexCount * sizeof(Vertex));
+	writer.align();
+	blobOffsets[1] = writer.bytes.size();
+	writer.write(data.indices, data.indexCount * indexSize);
+	memcpy(&writer.bytes[blobOffsetPosition], blobOffsets, sizeof(blobOffsets));
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Failed to write baked model: " << filename << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(writer.bytes.data()), writer.bytes.size());
+	return file.good();
+}
+
+bool loadBakedModel(const char *filename, ModelData &data)
+{
+	if (!data.mapping.open(filename)) {
+		std::cout << "Failed to open baked model: " << filename << std::endl;
+		return false;
+	}
+
+	BakedReader reader = {data.mapping.data, data.mapping.size, 0, true};
+
+	char magic[4];
+	reader.read(magic, sizeof(magic));
+	if (memcmp(magic, bakedMagic, sizeof(magic)) != 0 || reader.readU32() != bakedVersion) {
+		std::cout << "Wrong baked model version: " << filename << std::endl;
+		data.mapping.close();
+		return false;
+	}
+
+	data.vertexCount = reader.readU32();
+	data.indexCount = reader.readU32();
+	data.indexType = reader.readU32();
+	uint32_t vertexOffset = reader.readU32();
+	uint32_t indexOffset = reader.readU32();
+	reader.read(&data.boundsMin[0], 3 * sizeof(float));
+	reader.read(&data.boundsMax[0], 3 * sizeof(float));
+
+	data.materials.resize(reader.readCount(24));
+	for (size_t i = 0; i < data.materials.size(); i++) {
+		reader.read(&data.materials[i].BaseColorFactor[0], 4 * sizeof(float));
+		data.materials[i].MetallicFactor = reader.readF32();
+		data.materials[i].RoughnessFactor = reader.readF32();
+	}
+
+	data.meshes.resize(reader.readCount(4));
+	for (size_t m = 0; m < data.meshes.size(); m++) {
+		MeshData &mesh = data.meshes[m];
+		mesh.primitives.resize(reader.readCount(28));
+		for (size_t i = 0; i < mesh.primitives.size(); i++) {
+			PrimitiveData &primitive = mesh.primitives[i];
+			primitive.mode = reader.readU32();
+			primitive.material = reader.readI32();
+			primitive.indexCount = reader.readU32();
+			primitive.firstIndex = reader.readU32();
+			primitive.baseVertex = reader.readI32();
+			primitive.vertexCount = reader.readU32();
+			primitive.lodCount = std::min(std::max(reader.readU32(), 1u), (uint32_t)maxLods);
+			primitive.lodFirstIndex[0] = primitive.firstIndex;
+			primitive.lodIndexCount[0] = primitive.indexCount;
+			for (GLuint l = 1; l < primitive.lodCount; l++) {
+				primitive.lodFirstIndex[l] = reader.readU32();
+				primitive.lodIndexCount[l] = reader.readU32();
+			}
+		}
+	}
+
+	data.nodes.resize(reader.readCount(72));
+	for (size_t i = 0; i < data.nodes.size(); i++) {
+		reader.read(&data.nodes[i].transform[0][0], 16 * sizeof(float));
+		data.nodes[i].mesh = reader.readI32();
+		data.nodes[i].children.resize(reader.readCount(4));
+		for (size_t c = 0; c < data.nodes[i].children.size(); c++) {
+			data.nodes[i].children[c] = reader.readI32();
+		}
+	}
+
+	data.sceneNodes.resize(reader.readCount(4));
+	for (size_t i = 0; i < data.sceneNodes.size(); i++) {
+		data.sceneNodes[i] = reader.readI32();
+	}
+
+	data.skins.resize(reader.readCount(4));
+	for (size_t i = 0; i < data.skins.size(); i++) {
+		SkinObject &skin = data.skins[i];
+		skin.joints.resize(reader.readCount(68));
+		skin.inverseBindMatrices.resize(skin.joints.size());
+		for (size_t j = 0; j < skin.joints.size(); j++) {
+			skin.joints[j] = reader.readI32();
+			reader.read(&skin.inverseBindMatrices[j][0][0], 16 * sizeof(float));
+		}
+	}
+
+	data.animations.resize(reader.readCount(8));
+	for (size_t i = 0; i < data.animations.size(); i++) {
+		AnimationObject &animation = data.animations[i];
+		animation.samplers.resize(reader.readCount(12));
+		for (size_t s = 0; s < animation.samplers.size(); s++) {
+			SamplerObject &sampler = animation.samplers[s];
+			sampler.interpolation = reader.readI32();
+			sampler.input.resize(reader.readCount(sizeof(float)));
+			reader.read(sampler.input.data(), sampler.input.size() * sizeof(float));
+			sampler.output.resize(reader.readCount(sizeof(glm::vec4)));
+			reader.read(sampler.output.data(), sampler.output.size() * sizeof(glm::vec4));
+		}
+		animation.channels.resize(reader.readCount(12));
+		for (size_t c = 0; c < animation.channels.size(); c++) {
+			ChannelObject &channel = animation.channels[c];
+			channel.sampler = reader.readI32();
+			channel.targetNode = reader.readI32();
+			channel.targetPath = channelPaths[reader.readU32() % 3];
+		}
+	}
+
+	// Indices are only checked once everything is read, a bad one would crash the draw or the skinning
+	int nodeCount = data.nodes.size();
+	for (size_t i = 0; i < data.nodes.size(); i++) {
+		reader.valid = reader.valid && data.nodes[i].mesh < (int)data.meshes.size();
+		for (size_t c = 0; c < data.nodes[i].children.size(); c++) {
+			reader.valid = reader.valid && data.nodes[i].children[c] >= 0 && data.nodes[i].children[c] < nodeCount;
+		}
+	}
+	for (size_t i = 0; i < data.sceneNodes.size(); i++) {
+		reader.valid = reader.valid && data.sceneNodes[i] >= 0 && data.sceneNodes[i] < nodeCount;
+	}
+	for (size_t m = 0; m < data.meshes.size(); m++) {
+		for (size_t i = 0; i < data.meshes[m].primitives.size(); i++) {
+			const PrimitiveData &primitive = data.meshes[m].primitives[i];
+			reader.valid = reader.valid && primitive.firstIndex <= data.indexCount && primitive.indexCount <= data.indexCount - primitive.firstIndex
+				&& primitive.baseVertex >= 0 && (GLuint)primitive.baseVertex <= data.vertexCount
+				&& primitive.vertexCount <= data.vertexCount - primitive.baseVertex;
+			for (GLuint l = 1; l < primitive.lodCount; l++) {
+				reader.valid = reader.valid && primitive.lodFirstIndex[l] <= data.indexCount
+					&& primitive.lodIndexCount[l] <= data.indexCount - primitive.lodFirstIndex[l];
+			}
+		}
+	}
+	for (size_t i = 0; i < data.skins.size(); i++) {
+		reader.valid = reader.valid && !data.skins[i].joints.empty();
+		for (size_t j = 0; j < data.skins[i].joints.size(); j++) {
+			reader.valid = reader.valid && data.skins[i].joints[j] >= 0 && data.skins[i].joints[j] < nodeCount;
+		}
+	}
+	for (size_t i = 0; i < data.animations.size(); i++) {
+		const AnimationObject &animation = data.animations[i];
+		for (size_t c = 0; c < animation.channels.size(); c++) {
+			const ChannelObject &channel = animation.channels[c];
+			reader.valid = reader.valid && channel.targetNode >= 0 && channel.targetNode < nodeCount
+				&& channel.sampler >= 0 && channel.sampler < (int)animation.samplers.size();
+		}
+	}
+
+	// Blobs are used straight from the mapping, glBufferData will read the pages from there
+	size_t indexSize = (data.indexType == GL_UNSIGNED_INT) ? sizeof(uint32_t) : sizeof(uint16_t);
+	reader.valid = reader.valid && (data.indexType == GL_UNSIGNED_INT || data.indexType == GL_UNSIGNED_SHORT)
+		&& vertexOffset <= data.mapping.size && (size_t)data.vertexCount * sizeof(Vertex) <= data.mapping.size - vertexOffset
+		&& indexOffset <= data.mapping.size && (size_t)data.indexCount * indexSize <= data.mapping.size - indexOffset;
+	if (reader.valid) {
+		data.vertices = reinterpret_cast<const Vertex *>(data.mapping.data + vertexOffset);
+		data.indices = data.mapping.data + indexOffset;
+	}
+
+	if (!reader.valid) {
+		std::cout << "Corrupted baked model: " << filename << std::endl;
+		data.vertexCount = 0;
+		data.indexCount = 0;
+		data.meshes.clear();
+		data.nodes.clear();
+		data.sceneNodes.clear();
+		data.materials.clear();
+		data.skins.clear();
+		data.animations.clear();
+		data.mapping.close();
+		return false;
+	}
+
+	computeBindPose(data);
+
+	std::cout << "Loaded baked model: " << filename << std::endl;
+	return true;
+}
@@ -0,0 +1,48 @@
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Other relevant structs
+#include "../commonStructs.h"
+
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+//------------------------------------------------------------------//
+//																	//
+//		CPU side of the model loading. Models are turned into a     //
+//  ModelData, either from a GLTF file (the DOM is dropped once     //
+//  converted) or from a baked ".bmesh" file made by the bakeMesh   //
+//  tool, which is mapped and uploaded without any parsing.         //
+//  GLTF and GLB files are repacked in one interleaved vertex array //
+//  and one index array per model, the baked files store them as is.//
+//  Nothing in here uses OpenGL, it is safe to call from workers.   //
+//																	//
+//      loadModelData : Uses the baked file next to the GLTF when   //
+//          it is up to date, the GLTF otherwise.                   //
+//      loadGLTFModel / loadBakedModel : Force one of the formats.  //
+//          GLTF triangle lists go through the meshOptimizer unless //
+//          "optimize" is false, baked files already did. It also   //
+//          adds up to maxLods - 1 simplified index ranges each.    //
+//      releaseModelBuffers : Call once the buffers are uploaded.   //
+//      writeBakedModel : Used by the bake tool.                    //
+//																	//
+//------------------------------------------------------------------//
+
+// Loading
+bool loadModelData(const char *filename, ModelData &data, bool optimize = true);
+bool loadGLTFModel(const char *filename, ModelData &data, bool optimize = true);
+bool loadBakedModel(const char *filename, ModelData &data);
+
+// Drops the vertices and indices once they have been uploaded
+void releaseModelBuffers(ModelData &data);
+
+// Baking
+std::string bakedModelPath(const char *filename);
+bool writeBakedModel(const char *filename, const ModelData &data);
+
+// Nodes computations
+void computeGlobalNodeTransform(const ModelData &data, const std::vector<glm::mat4> &localTransforms, int nodeIndex, const glm::mat4 &parentTransform, std::vector<glm::mat4> &globalTransforms);
+
+#endif //MODELLOADER_H
@@ -0,0 +1,613 @@
+#include "staticBatch.h"
+#include "gltfObj.h"
+#include "impostor.h"
+#include "modelLoader.h"
+
+#include <render/glExtensions.h>
+#include <render/streamBuffer.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+void StaticBatch::add(gltfObj *member)
+{
+	members.push_back(member);
+}
+
+void StaticBatch::mark(int slot, RenderPass pass)
+{
+	if (slot >= 0)
+	{
+		marked[pass][slot] = true;
+	}
+}
+
+BatchGroup *StaticBatch::findGroup(GLuint shaderFeatures, GLuint textureID)
+{
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		if (groups[i].shaderFeatures == shaderFeatures && groups[i].textureID == textureID)
+		{
+			return &groups[i];
+		}
+	}
+
+	BatchGroup group;
+	group.batch = this;
+	group.shaderFeatures = shaderFeatures;
+	group.depthShaderFeatures = obj_dpth | obj_b | obj_i;
+	group.textureID = textureID;
+	groups.push_back(group);
+	return &groups.back();
+}
+
+// Only what is drawn from the bind pose, in triangle lists (instances are appended one after the other) and still in memory
+bool StaticBatch::canMerge(const gltfObj *member)
+{
+	if (member->modelAsset == NULL || !member->modelAsset->committed || member->animationON)
+	{
+		return false;
+	}
+
+	const ModelData &data = member->modelAsset->data;
+	if (data.vertices == NULL || data.indices == NULL)
+	{
+		return false;
+	}
+
+	for (size_t m = 0; m < data.meshes.size(); m++)
+	{
+		for (size_t i = 0; i < data.meshes[m].primitives.size(); i++)
+		{
+			if (data.meshes[m].primitives[i].mode != GL_TRIANGLES)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Same traversal as gltfObj::drawModelNodes, a mesh is added every time a node draws it
+void StaticBatch::appendNode(int slot, BatchGroup &group, int nodeIndex)
+{
+	const ModelData &data = members[slot]->modelAsset->data;
+	const NodeData &node = data.nodes[nodeIndex];
+
+	if ((node.mesh >= 0) && (node.mesh < (int)data.meshes.size())) {
+		const MeshData &mesh = data.meshes[node.mesh];
+		for (size_t i = 0; i < mesh.primitives.size(); i++)
+		{
+			appendPrimitive(slot, group, mesh.primitives[i]);
+		}
+	}
+	for (size_t i = 0; i < node.children.size(); i++) {
+		appendNode(slot, group, node.children[i]);
+	}
+}
+
+// Skins the primitive in bind pose once, the instances are placed when drawing
+void StaticBatch::appendPrimitive(int slot, BatchGroup &group, const PrimitiveData &primitive)
+{
+	const gltfObj *member = members[slot];
+	const ModelData &data = member->modelAsset->data;
+
+	BatchRange range;
+	range.lodCount = primitive.lodCount;
+	range.baseVertex = vertices.size();
+	GLfloat drawIndex = group.ranges.size();
+
+	for (GLuint v = 0; v < primitive.vertexCount; v++)
+	{
+		const Vertex &vertex = data.vertices[primitive.baseVertex + v];
+
+		// Same normalised weights as the SKINNING variant
+		glm::mat4 skinMat(1.0f);
+		float totalWeight = vertex.weights.x + vertex.weights.y + vertex.weights.z + vertex.weights.w;
+		if (!member->skinObjects.empty() && totalWeight > 0.0f)
+		{
+			const std::vector<glm::mat4> &jointMatrices = member->skinObjects[0].jointMatrices;
+			skinMat = glm::mat4(0.0f);
+			for (int j = 0; j < 4; j++)
+			{
+				skinMat += jointMatrices[vertex.joints[j]] * (vertex.weights[j] / totalWeight);
+			}
+		}
+
+		BatchVertex batchVertex;
+		batchVertex.position = glm::vec3(skinMat * glm::vec4(vertex.position, 1.0f));
+		batchVertex.normal = glm::normalize(glm::vec3(glm::transpose(glm::inverse(skinMat)) * glm::vec4(vertex.normal, 0.0f)));
+		batchVertex.uv = vertex.uv;
+		batchVertex.drawIndex = drawIndex;
+		vertices.push_back(batchVertex);
+	}
+
+	// Every level indexes the same vertices, indices stay relative to the range, the draw adds its base vertex
+	for (GLuint l = 0; l < primitive.lodCount; l++)
+	{
+		range.counts[l] = primitive.lodIndexCount[l];
+		range.firstIndices[l] = indices.size();
+		for (GLuint i = 0; i < primitive.lodIndexCount[l]; i++)
+		{
+			GLuint index = primitive.lodFirstIndex[l] + i;
+			if (data.indexType == GL_UNSIGNED_INT)
+			{
+				indices.push_back(((const GLuint *)data.indices)[index]);
+			}
+			else
+			{
+				indices.push_back(((const GLushort *)data.indices)[index]);
+			}
+		}
+	}
+
+	glm::vec4 color(1.0f);
+	if (primitive.material >= 0 && primitive.material < (GLint)data.materials.size())
+	{
+		color = data.materials[primitive.material].BaseColorFactor;
+	}
+
+	memberRanges[slot].push_back(std::make_pair((int)(&group - &groups[0]), (int)group.ranges.size()));
+	group.ranges.push_back(range);
+	group.drawColors.push_back(color);
+}
+
+// The member draws on its own, its commit skipped queueing its variants while it was in the batch
+void StaticBatch::leaveBatch(gltfObj *member)
+{
+	member->batch = NULL;
+	queueObjProgram(member->shaderFeatures);
+	queueObjProgram(member->depthShaderFeatures);
+}
+
+// Merge every member, upload the result and queue the programs, members are all committed by now
+void StaticBatch::build()
+{
+	if (built)
+	{
+		return;
+	}
+
+	memberFirstSpheres.assign(members.size(), 0);
+	memberRanges.assign(members.size(), std::vector<std::pair<int, int> >());
+
+	for (size_t slot = 0; slot < members.size(); slot++)
+	{
+		gltfObj *member = members[slot];
+		if (!canMerge(member))
+		{
+			leaveBatch(member);
+			continue;
+		}
+
+		// Skinning is baked in the vertices, every member is drawn instanced
+		GLuint shaderFeatures = (member->shaderFeatures | obj_b | obj_i) & ~obj_a;
+		BatchGroup &group = *findGroup(shaderFeatures, member->textureID);
+
+		size_t vertexCount = vertices.size();
+		size_t indexCount = indices.size();
+		size_t rangeCount = group.ranges.size();
+
+		// The batch is placed without the mod values, submit scales all of it
+		member->genModelMat(member->position, member->scale);
+
+		const ModelData &data = member->modelAsset->data;
+		for (size_t i = 0; i < data.sceneNodes.size(); ++i) {
+			appendNode(slot, group, data.sceneNodes[i]);
+		}
+
+		// No room left in the colors block, this one draws on its own
+		if (group.ranges.size() > (size_t)maxBatchDraws)
+		{
+			vertices.resize(vertexCount);
+			indices.resize(indexCount);
+			group.ranges.resize(rangeCount);
+			group.drawColors.resize(rangeCount);
+			memberRanges[slot].clear();
+			leaveBatch(member);
+			continue;
+		}
+
+		// Culling spheres, from the model bounds
+		glm::vec3 center = (data.boundsMin + data.boundsMax) * 0.5f;
+		float radius = glm::length(data.boundsMax - data.boundsMin) * 0.5f;
+		memberFirstSpheres[slot] = spheres.size();
+		spheres.resize(spheres.size() + member->instanced);
+		for (GLuint instance = 0; instance < member->instanced; instance++)
+		{
+			spheres.setTransformed(memberFirstSpheres[slot] + instance, member->modelMat[instance], center, radius);
+			sphereMembers.push_back(slot);
+			sphereMatrices.push_back(member->modelMat[instance]);
+		}
+
+		member->batchSlot = slot;
+	}
+
+	sphereLods.assign(spheres.size(), 0);
+
+	// Every member kept its CPU buffers for us
+	for (size_t slot = 0; slot < members.size(); slot++)
+	{
+		if (members[slot]->modelAsset != NULL)
+		{
+			releaseModelBuffers(members[slot]->modelAsset->data);
+		}
+	}
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BatchVertex), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	// Interleaved layout, see BatchVertex
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), BUFFER_OFFSET(offsetof(BatchVertex, position)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), BUFFER_OFFSET(offsetof(BatchVertex, normal)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), BUFFER_OFFSET(offsetof(BatchVertex, uv)));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), BUFFER_OFFSET(offsetof(BatchVertex, drawIndex)));
+
+	// The instance stream, same locations as gltfObj, the draws pick their matrices through the base instance
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (passOpaque + 1) * spheres.size() * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+	for (int i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(5 + i);
+		glVertexAttribDivisor(5 + i, 1);
+	}
+	pointInstances(0);
+
+	glBindVertexArray(0);
+
+	// The whole block is allocated, the shader declares all of it
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		BatchGroup &group = groups[i];
+		glGenBuffers(1, &group.colorBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, group.colorBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, maxBatchDraws * sizeof(glm::vec4), NULL, GL_STATIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, group.drawColors.size() * sizeof(glm::vec4), group.drawColors.data());
+
+		queueObjProgram(group.shaderFeatures);
+		queueObjProgram(group.depthShaderFeatures);
+	}
+	colorsBinding = getBlockBinding("batchColors");
+
+	// The GPU has its copy
+	std::vector<BatchVertex>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+
+	for (int pass = 0; pass <= passOpaque; pass++)
+	{
+		marked[pass].assign(members.size(), false);
+	}
+	built = true;
+}
+
+// Done on first use so the variants are built with everything else queued
+void StaticBatch::bindPrograms(BatchGroup &group)
+{
+	group.programID = getObjProgram(group.shaderFeatures);
+	group.depthProgramID = getObjProgram(group.depthShaderFeatures);
+	group.uniforms = &getObjUniforms(group.shaderFeatures);
+	group.depthUniforms = &getObjUniforms(group.depthShaderFeatures);
+	group.programsBound = true;
+}
+
+// Queue callback, packets point at their group
+static void drawGroup(void *object, RenderPass pass, const FrameContext &context)
+{
+	BatchGroup *group = static_cast<BatchGroup *>(object);
+	group->batch->draw(*group, pass, context);
+}
+
+// Cull the instances the members asked for, one packet per group and pass, then forget the marks for the next frame
+void StaticBatch::submit(RenderQueue &queue, const FrameContext &context, GLfloat mod)
+{
+	if (!built)
+	{
+		return;
+	}
+	this -> mod = mod;
+
+	// The spheres are in the batch space, the pass matrices are brought to it
+	glm::mat4 modMat = glm::scale(glm::mat4(1.0f), glm::vec3(mod));
+
+	for (int pass = 0; pass <= passOpaque; pass++)
+	{
+		bool depth = (pass == passDepth);
+
+		// The batch never moves, its shadow stays in the cached map until the light or the mod value change
+		if (depth && !context.staticShadowsDirty)
+		{
+			marked[pass].assign(members.size(), false);
+			continue;
+		}
+		glm::mat4 viewProjection = (depth ? context.lightMatrix : context.cameraMatrix) * modMat;
+		glm::vec3 viewer = (depth ? context.lightPosition : context.eye) / mod;
+
+		cullSpheres(frustumFromMatrix(viewProjection), spheres, visibleSpheres);
+		sortFrontToBack(spheres, viewer, visibleSpheres);
+
+		// From the camera, the shadow map is drawn at the full level
+		if (!depth)
+		{
+			selectLods(spheres, visibleSpheres, context.eye / mod, context.lodScale, sphereLods);
+		}
+
+		// The instances kept, counted per member and level
+		keptSpheres.clear();
+		bucketCounts.assign(members.size() * maxLods, 0);
+		for (size_t v = 0; v < visibleSpheres.size(); v++)
+		{
+			int slot = sphereMembers[visibleSpheres[v]];
+			if (!marked[pass][slot])
+			{
+				continue;
+			}
+
+			// Hidden behind the CPU occluders, tested in world space (the occluders themselves are not)
+			if (!depth && context.softOcclusion != NULL && members[slot]->occluder == NULL)
+			{
+				GLuint s = visibleSpheres[v];
+				if (context.softOcclusion->isSphereOccluded(glm::vec3(spheres.x[s], spheres.y[s], spheres.z[s]) * mod, spheres.radius[s] * mod))
+				{
+					continue;
+				}
+			}
+
+			// The member matrices are the ones the batch was placed with, the mod values excepted
+			// The cached shadow map cannot follow the camera, it gets the full meshes and no impostor
+			Impostor *impostor = members[slot]->impostor;
+			if (!depth && impostor != NULL && impostor->baked && sphereLods[visibleSpheres[v]] >= impostorLod)
+			{
+				impostor->addInstance((RenderPass)pass, modMat * sphereMatrices[visibleSpheres[v]]);
+				continue;
+			}
+
+			GLuint level = depth ? 0 : std::min((GLuint)sphereLods[visibleSpheres[v]], (GLuint)maxLods - 1);
+			keptSpheres.push_back(visibleSpheres[v]);
+			bucketCounts[slot * maxLods + level]++;
+		}
+
+		// Each member and level gets its run of the instance stream, still front to back within it
+		bucketFirst.resize(bucketCounts.size());
+		GLuint total = 0;
+		for (size_t b = 0; b < bucketCounts.size(); b++)
+		{
+			bucketFirst[b] = total;
+			total += bucketCounts[b];
+		}
+		visibleMatrices.resize(total);
+		// The counts are not needed anymore, they become where each run is written
+		std::vector<GLuint> &cursors = bucketCounts;
+		for (size_t b = 0; b < cursors.size(); b++)
+		{
+			cursors[b] = bucketFirst[b];
+		}
+		for (size_t k = 0; k < keptSpheres.size(); k++)
+		{
+			GLuint s = keptSpheres[k];
+			int slot = sphereMembers[s];
+			GLuint level = depth ? 0 : std::min((GLuint)sphereLods[s], (GLuint)maxLods - 1);
+			visibleMatrices[cursors[slot * maxLods + level]++] = sphereMatrices[s];
+		}
+		uploadInstances((RenderPass)pass);
+
+		// One instanced draw per range of every member and level kept, the cursors ended on the end of each run
+		for (size_t i = 0; i < groups.size(); i++)
+		{
+			groups[i].commands[pass].clear();
+		}
+		GLuint passFirst = pass * spheres.size();
+		for (size_t slot = 0; slot < members.size(); slot++)
+		{
+			for (GLuint l = 0; l < maxLods; l++)
+			{
+				size_t b = slot * maxLods + l;
+				GLuint instances = cursors[b] - bucketFirst[b];
+				if (instances == 0)
+				{
+					continue;
+				}
+
+				for (size_t r = 0; r < memberRanges[slot].size(); r++)
+				{
+					BatchGroup &group = groups[memberRanges[slot][r].first];
+					const BatchRange &range = group.ranges[memberRanges[slot][r].second];
+					GLuint level = std::min(l, range.lodCount - 1);
+
+					DrawElementsIndirectCommand command;
+					command.count = range.counts[level];
+					command.instanceCount = instances;
+					command.firstIndex = range.firstIndices[level];
+					command.baseVertex = range.baseVertex;
+					command.baseInstance = passFirst + bucketFirst[b];
+					group.commands[pass].push_back(command);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < groups.size(); i++)
+		{
+			BatchGroup &group = groups[i];
+			if (group.commands[pass].empty())
+			{
+				continue;
+			}
+
+			if (!group.programsBound)
+			{
+				bindPrograms(group);
+			}
+
+			// Everything is in one buffer, the distance part of the key does not mean anything here
+			GLuint program = depth ? group.depthProgramID : group.programID;
+			GLuint texture = depth ? 0 : group.textureID;
+			queue.submit(makeSortKey(depth ? passStaticDepth : passOpaque, program, texture, vao, 0.0f), &group, drawGroup);
+
+			// Same draws depth only first, the color pass then shades each pixel once
+			if (!depth && context.depthPrepass)
+			{
+				queue.submit(makeSortKey(passPrepass, group.depthProgramID, 0, vao, 0.0f), &group, drawGroup);
+			}
+		}
+
+		marked[pass].assign(members.size(), false);
+	}
+}
+
+void StaticBatch::draw(BatchGroup &group, RenderPass pass, const FrameContext &context)
+{
+	// The pre-pass draws what the opaque pass kept, depth only and from the camera, the static shadow map what the depth pass kept
+	bool depth = (pass != passOpaque);
+	glm::mat4 viewProjection = (pass == passPrepass) ? context.cameraMatrix : context.lightMatrix;
+	if (pass == passPrepass)
+	{
+		pass = passOpaque;
+	}
+	else if (pass == passStaticDepth)
+	{
+		pass = passDepth;
+	}
+
+	const ObjUniforms &uniforms = depth ? *group.depthUniforms : *group.uniforms;
+	glUseProgram(depth ? group.depthProgramID : group.programID);
+
+	// The vertices are placed, only the mod values are left
+	glm::mat4 modMat = glm::scale(glm::mat4(1.0f), glm::vec3(mod));
+	if (depth)
+	{
+		glm::mat4 mvp = viewProjection * modMat;
+		glUniformMatrix4fv(uniforms.mvp, 1, GL_FALSE, &mvp[0][0]);
+	}
+	else
+	{
+		glm::mat4 mvp = context.cameraMatrix * modMat;
+		glUniformMatrix4fv(uniforms.mvp, 1, GL_FALSE, &mvp[0][0]);
+
+		if (uniforms.lvp >= 0)
+		{
+			glm::mat4 lvp = context.lightMatrix * modMat;
+			glUniformMatrix4fv(uniforms.lvp, 1, GL_FALSE, &lvp[0][0]);
+		}
+
+		if (uniforms.depthTextureUnit >= 0)
+		{
+			glActiveTexture(GL_TEXTURE0 + uniforms.depthTextureUnit);
+			glBindTexture(GL_TEXTURE_2D, context.depthTexture);
+		}
+		if (uniforms.textureUnit >= 0)
+		{
+			glActiveTexture(GL_TEXTURE0 + uniforms.textureUnit);
+			glBindTexture(GL_TEXTURE_2D, group.textureID);
+		}
+
+		glUniform3fv(uniforms.lightPosition, 1, &context.lightPosition[0]);
+		glUniform3fv(uniforms.lightIntensity, 1, &context.lightIntensity[0]);
+		glBindBufferBase(GL_UNIFORM_BUFFER, colorsBinding, group.colorBuffer);
+	}
+
+	glBindVertexArray(vao);
+
+	const std::vector<DrawElementsIndirectCommand> &commands = group.commands[pass];
+	GLsizei drawCount = commands.size();
+
+	// The commands go through the frame stream, the driver reads them without a round trip through the API
+	if (hasMultiDrawIndirect() && hasBaseInstance())
+	{
+		GLintptr commandOffset;
+		if (frameStream.write(commands.data(), drawCount * sizeof(DrawElementsIndirectCommand), commandOffset))
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frameStream.buffer);
+			ext_glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, BUFFER_OFFSET(commandOffset), drawCount, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			return;
+		}
+	}
+
+	// No base instance in GL 3.3, the instance stream is moved to the first matrix of each draw instead
+	for (GLsizei i = 0; i < drawCount; i++)
+	{
+		const DrawElementsIndirectCommand &command = commands[i];
+		pointInstances(command.baseInstance);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, BUFFER_OFFSET(command.firstIndex * sizeof(GLuint)),
+			command.instanceCount, command.baseVertex);
+	}
+	pointInstances(0);
+}
+
+// Instance attributes of the bound vao, starting at that matrix of the stream
+void StaticBatch::pointInstances(GLuint firstInstance)
+{
+	std::size_t rowSize = sizeof(glm::vec4);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (int i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, 4 * rowSize, BUFFER_OFFSET(firstInstance * sizeof(glm::mat4) + i * rowSize));
+	}
+}
+
+// The matrices kept for the pass go to its block, written once in the frame stream then copied by the GPU
+void StaticBatch::uploadInstances(RenderPass pass)
+{
+	if (visibleMatrices.empty())
+	{
+		return;
+	}
+
+	GLintptr block = pass * spheres.size() * sizeof(glm::mat4);
+	GLsizeiptr size = visibleMatrices.size() * sizeof(glm::mat4);
+	GLintptr streamOffset = 0;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+	if (frameStream.write(visibleMatrices.data(), size, streamOffset))
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, frameStream.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, streamOffset, block, size);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	else
+	{
+		glBufferSubData(GL_COPY_WRITE_BUFFER, block, size, visibleMatrices.data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StaticBatch::cleanup()
+{
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		glDeleteBuffers(1, &groups[i].colorBuffer);
+	}
+	groups.clear();
+
+	if (built)
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vertexBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+		glDeleteBuffers(1, &instanceBuffer);
+		vao = vertexBuffer = indexBuffer = instanceBuffer = 0;
+	}
+	members.clear();
+	spheres.resize(0);
+	sphereMembers.clear();
+	sphereMatrices.clear();
+	memberFirstSpheres.clear();
+	memberRanges.clear();
+	sphereLods.clear();
+	built = false;
+}
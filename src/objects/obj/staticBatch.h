@@ -0,0 +1,143 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include <render/glExtensions.h>
+#include <render/renderQueue.h>
+#include <render/frustum.h>
+#include <render/shaderManager.h>
+
+#include "../commonStructs.h"
+
+#ifndef STATICBATCH_H
+#define STATICBATCH_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Merges the gltfObj that never move nor animate in one       //
+//  vertex and one index buffer, so they are drawn with one multi   //
+//  draw per program and texture instead of one call per primitive. //
+//  The bind pose is applied once when building, each member        //
+//  primitive is stored once as a range of its group and drawn      //
+//  instanced, the matrices of its visible instances are compacted  //
+//  in an instance stream (mod values excepted, the whole batch is  //
+//  scaled by the one given to submit). Its base color is read from //
+//  a uniform block indexed by a per-vertex draw index.             //
+//																	//
+//      add : Done by gltfObj::init_b, before the member's commit.  //
+//      build : After every member is committed, uploads the batch  //
+//          and drops the members CPU buffers. Members that cannot  //
+//          be merged (animated, not triangles, group full) keep    //
+//          drawing on their own.                                   //
+//      mark : Done by gltfObj::submit, the member is drawn in that //
+//          pass of the frame.                                      //
+//      submit : Queues one packet per group holding marked members,//
+//          after the members were submitted. Instances are culled  //
+//          against the frustum of each pass, front to back within  //
+//          each member and level of detail. Draws go through       //
+//          glMultiDrawElementsIndirect when the driver has it with //
+//          base instances, one glDrawElementsInstancedBaseVertex   //
+//          per range otherwise.                                    //
+//          The shadow casters go to passStaticDepth, at the full   //
+//          level, and only when the context says the cached static //
+//          shadow map is dirty.                                    //
+//																	//
+//------------------------------------------------------------------//
+
+struct gltfObj;
+struct StaticBatch;
+
+// Size of the batchColors block in obj.vert
+const int maxBatchDraws = 256;
+
+// Already skinned, the layout the BATCHED variant reads, the instance matrices place it
+struct BatchVertex {
+    glm::vec3 position;                 // location 0, skinned model space, the light is computed with it
+    glm::vec3 normal;                   // location 1, skinned
+    glm::vec2 uv;                       // location 2
+    GLfloat drawIndex;                  // location 3
+};
+
+// One member primitive, stored once whatever the number of instances
+struct BatchRange {
+    GLuint lodCount;
+    GLsizei counts[maxLods];
+    GLuint firstIndices[maxLods];
+    GLint baseVertex;
+};
+
+// Members sharing a program variant and a texture, drawn with one call per pass
+struct BatchGroup {
+    StaticBatch *batch = NULL;
+    GLuint shaderFeatures = 0;
+    GLuint depthShaderFeatures = 0;
+    GLuint textureID = 0;
+
+    // Handles of the variants, fetched on the first submit like gltfObj::bindPrograms
+    bool programsBound = false;
+    GLuint programID = 0;
+    GLuint depthProgramID = 0;
+    const ObjUniforms *uniforms = NULL;
+    const ObjUniforms *depthUniforms = NULL;
+
+    std::vector<BatchRange> ranges;
+    std::vector<glm::vec4> drawColors;
+    GLuint colorBuffer = 0;
+
+    // One instanced draw per range and level of the visible members, per pass
+    std::vector<DrawElementsIndirectCommand> commands[passOpaque + 1];
+};
+
+struct StaticBatch {
+
+    void add(gltfObj *member);
+    void build();
+    void mark(int slot, RenderPass pass);
+    void submit(RenderQueue &queue, const FrameContext &context, GLfloat mod = 1.0f);
+    void draw(BatchGroup &group, RenderPass pass, const FrameContext &context);
+    void cleanup();
+
+    // Building
+    BatchGroup *findGroup(GLuint shaderFeatures, GLuint textureID);
+    bool canMerge(const gltfObj *member);
+    void appendNode(int slot, BatchGroup &group, int nodeIndex);
+    void appendPrimitive(int slot, BatchGroup &group, const PrimitiveData &primitive);
+    void leaveBatch(gltfObj *member);
+    void bindPrograms(BatchGroup &group);
+    void pointInstances(GLuint firstInstance);
+    void uploadInstances(RenderPass pass);
+
+    std::vector<gltfObj *> members;
+    std::vector<bool> marked[passOpaque + 1];
+    std::vector<BatchGroup> groups;
+
+    // One sphere per member instance, placed like the vertices
+    SphereSet spheres;
+    std::vector<int> sphereMembers;
+    std::vector<GLuint> memberFirstSpheres;
+    std::vector<std::vector<std::pair<int, int> > > memberRanges;    // Group and range of each member primitive
+    std::vector<GLuint> visibleSpheres;
+    std::vector<unsigned char> sphereLods;
+    std::vector<glm::mat4> sphereMatrices;
+
+    // Kept instances of the pass, grouped by member and level (bucket slot * maxLods + level)
+    std::vector<GLuint> keptSpheres;
+    std::vector<GLuint> bucketCounts;
+    std::vector<GLuint> bucketFirst;
+    std::vector<glm::mat4> visibleMatrices;
+
+    // Only used while building
+    std::vector<BatchVertex> vertices;
+    std::vector<GLuint> indices;
+
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint instanceBuffer = 0;          // One block of a matrix per sphere for each pass
+    GLuint colorsBinding = 0;
+    GLfloat mod = 1.0f;
+    bool built = false;
+};
+
+#endif //STATICBATCH_H
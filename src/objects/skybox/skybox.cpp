@@ -1,6 +1,16 @@
+#include <tiny_gltf.h>
 #include "skybox.h"
 
 #include <helpers.h>
+#include <render/assetCache.h>
+#include <render/shaderManager.h>
+
+// Decode the six faces, each one is its own task when a pool is given
+void Skybox::prepare(ThreadPool *pool) {
+	for (int i = 0; i < 6; i++) {
+		textureAssets[i] = acquireTexture(texturePaths[i], pool);
+	}
+}
 
 void Skybox::initialize(glm::vec3 scale,glm::vec3 position ) {
 	// Define scale of the skybox geometry
@@ -37,25 +47,29 @@ void Skybox::initialize(glm::vec3 scale,glm::vec3 position ) {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(samplerIndex_buffer_data), samplerIndex_buffer_data, GL_STATIC_DRAW);
 
 	// Create and compile our GLSL program from the shaders
-	programID = LoadShadersFromFile("../src/shaders/skybox.vert", "../src/shaders/skybox.frag");
+	programID = getProgram("../src/shaders/skybox.vert", "../src/shaders/skybox.frag");
 	if (programID == 0)
 	{
 		std::cerr << "Failed to load shaders." << std::endl;
 	}
 
 	// Get a handle for our "MVP" uniform
-	mvpMatrixID = glGetUniformLocation(programID, "MVP");
+	const ProgramReflection &reflection = getProgramReflection(programID);
+	mvpMatrixID = reflection.uniform("MVP");
 
 
-    // Load the textures
+    // Load the textures, decoding them now if prepare was not used
+	if (textureAssets[0] == NULL) {
+		prepare();
+	}
 	for (int i = 0; i < 6; i++) {
-		textureIDs[i] = LoadTextureTileBox(texturePaths[i]);
+		textureIDs[i] = commitTexture(textureAssets[i]);
 	}
 
-    // Get handles for the texture samplers
+    // Get the units the texture samplers were set to
 	for (int i = 0; i < 6; i++)
 	{
-		textureSamplerIDs[i] = glGetUniformLocation(programID, ("textureSampler" + std::to_string(i)).c_str() );
+		textureUnits[i] = reflection.samplerUnit(("textureSampler" + std::to_string(i)).c_str());
 	}
 	glBindVertexArray(0);
 }
@@ -98,9 +112,8 @@ void Skybox::render(glm::mat4 cameraMatrix, glm::vec3 scale) {
 
 	// Send texture face by face
 	for (int i = 0; i < 6; i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
+		glActiveTexture(GL_TEXTURE0 + textureUnits[i]);
 		glBindTexture(GL_TEXTURE_2D, textureIDs[i]);
-		glUniform1i(textureSamplerIDs[i], i);
 	}
 
     // ------------------------------------------
@@ -115,13 +128,33 @@ void Skybox::render(glm::mat4 cameraMatrix, glm::vec3 scale) {
 	glBindVertexArray(0);
 }
 
+// Queue callback, packets point at their skybox, the pre-pass draws the same box with the color writes off
+static void drawSkybox(void *object, RenderPass /*pass*/, const FrameContext &context)
+{
+	Skybox *skybox = static_cast<Skybox *>(object);
+	skybox->render(context.cameraMatrix, skybox->renderScale);
+}
+
+// The box surrounds everything, it always goes last of its group whatever its center
+void Skybox::submit(RenderQueue &queue, glm::vec3 scale, const FrameContext &context) {
+	renderScale = scale;
+	queue.submit(makeSortKey(passOpaque, programID, textureIDs[0], vertexArrayID, 1.0f), this, drawSkybox);
+	if (context.depthPrepass) {
+		queue.submit(makeSortKey(passPrepass, programID, textureIDs[0], vertexArrayID, 1.0f), this, drawSkybox);
+	}
+}
+
 void Skybox::cleanup() {
 	glDeleteBuffers(1, &vertexBufferID);
 	glDeleteBuffers(1, &colorBufferID);
 	glDeleteBuffers(1, &indexBufferID);
 	glDeleteVertexArrays(1, &vertexArrayID);
 	glDeleteBuffers(1, &uvBufferID);
-	glDeleteProgram(programID);
+
+	for (int i = 0; i < 6; i++) {
+		releaseTexture(textureAssets[i]);
+		textureAssets[i] = NULL;
+	}
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
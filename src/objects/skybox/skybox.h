@@ -2,27 +2,37 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <render/shader.h>
+#include <render/renderQueue.h>
 
 #ifndef SKYBOX_H
 #define SKYBOX_H
 
+struct ThreadPool;
+struct TextureAsset;
+
 //------------------------------------------------------------------//
 //																	//
 //		This structure allows you to create a skybox object			//
 //		Shaders path are implemented inside "initialize" if			//
-//		they need to be changed.									//
+//		they need to be changed. "prepare" can be called first		//
+//		to decode the six faces on a ThreadPool.					//
+//		"submit" queues it in the opaque pass of a RenderQueue,		//
+//		and in the depth pre-pass when the context has it on.		//
 //																	//
 //------------------------------------------------------------------//
 
 struct Skybox {
 
+	void prepare(ThreadPool *pool = NULL);
 	void initialize(glm::vec3 scale = glm::vec3(1.0f),glm::vec3 position = glm::vec3(0.0f));
 	void render(glm::mat4 cameraMatrix, glm::vec3 scale);
+	void submit(RenderQueue &queue, glm::vec3 scale, const FrameContext &context);
 	void cleanup();
 
 	// All transforms
 	glm::vec3 position;		// Position of the box
 	glm::vec3 scale;		// Size of the box in each axis
+	glm::vec3 renderScale;	// Scale given to submit, used when the queue draws us
 
 	// OpenGL buffers
 	GLuint vertexArrayID;
@@ -33,11 +43,12 @@ struct Skybox {
 	GLuint samplerIndex_buffer_ID;
 
 	// Handling textures (One texture/sampler per face)
+	TextureAsset *textureAssets[6] = {NULL, NULL, NULL, NULL, NULL, NULL};	// Shared textures from the cache
 	GLuint textureIDs[6];			// All the loaded textures
-	GLuint textureSamplerIDs[6];	// All the texture samplers IDs
+	GLint textureUnits[6];			// Texture unit of each sampler
 
 	// Render var ID
-	GLuint mvpMatrixID;
+	GLint mvpMatrixID;
 
 	// Shader variable IDs
 	GLuint programID;
@@ -0,0 +1,97 @@
+#include "assetCache.h"
+
+#include <iostream>
+
+#include "helpers.h"
+
+// All the assets currently in use, keyed by path
+static std::map<std::string, ModelAsset *> models;
+static std::map<std::string, TextureAsset *> textures;
+
+ModelAsset *acquireModel(const char *filename)
+{
+	std::string path(filename);
+
+	std::map<std::string, ModelAsset *>::iterator it = models.find(path);
+	if (it != models.end())
+	{
+		it->second->refCount++;
+		return it->second;
+	}
+
+	// First request for this path, the caller will fill it
+	ModelAsset *asset = new ModelAsset();
+	asset->path = path;
+	asset->refCount = 1;
+	models[path] = asset;
+
+	return asset;
+}
+
+void releaseModel(ModelAsset *asset)
+{
+	if (asset == NULL || --asset->refCount > 0)
+	{
+		return;
+	}
+
+	glDeleteVertexArrays(1, &asset->vao);
+	glDeleteBuffers(1, &asset->vertexBuffer);
+	glDeleteBuffers(1, &asset->indexBuffer);
+	glDeleteBuffers(1, &asset->bindPoseBuffer);
+
+	models.erase(asset->path);
+	delete asset;
+}
+
+TextureAsset *acquireTexture(const char *texturePath, ThreadPool *pool)
+{
+	std::string path(texturePath);
+
+	std::map<std::string, TextureAsset *>::iterator it = textures.find(path);
+	if (it != textures.end())
+	{
+		it->second->refCount++;
+		return it->second;
+	}
+
+	TextureAsset *asset = new TextureAsset();
+	asset->path = path;
+	asset->refCount = 1;
+	textures[path] = asset;
+
+	// Decode the image, in the background if we can
+	if (pool != NULL)
+	{
+		pool->submit([asset] { asset->image = DecodeTexture(asset->path.c_str()); });
+	}
+	else
+	{
+		asset->image = DecodeTexture(asset->path.c_str());
+	}
+
+	return asset;
+}
+
+GLuint commitTexture(TextureAsset *asset)
+{
+	if (asset->textureID == 0)
+	{
+		asset->textureID = UploadTexture(asset->image);
+	}
+	return asset->textureID;
+}
+
+void releaseTexture(TextureAsset *asset)
+{
+	if (asset == NULL || --asset->refCount > 0)
+	{
+		return;
+	}
+
+	glDeleteTextures(1, &asset->textureID);
+	FreeImageData(asset->image);
+
+	textures.erase(asset->path);
+	delete asset;
+}
@@ -0,0 +1,80 @@
+#include <glad/gl.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Other relevant structs
+#include "objects/commonStructs.h"
+
+#include "helpers.h"
+#include <render/threadPool.h>
+
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Shared model and texture cache. Assets are keyed by their   //
+//  path, loaded once and handed out with a reference count, so     //
+//  objects using the same file only pay for their own instance     //
+//  state (transforms, joint matrices, instance buffers).           //
+//																	//
+//  Loading is split in two phases : a CPU "prepare" phase that     //
+//  can run on a ThreadPool and a GL "commit" phase that must run   //
+//  on the render thread once the pool is done. The cache itself    //
+//  is only touched from the render thread, workers only write in   //
+//  the asset they were given.                                      //
+//																	//
+//  Models :                                                        //
+//      acquireModel : Returns the shared asset for a path, the     //
+//          caller queues its preparation if "queued" is false.     //
+//      releaseModel : Drops a reference, GL buffers are deleted    //
+//          with the last one.                                      //
+//																	//
+//  Textures :                                                      //
+//      acquireTexture : Returns the shared texture, decoding is    //
+//          queued on the pool (or done now) on first use.          //
+//      commitTexture : Uploads the decoded image, only once.       //
+//      releaseTexture : Same as releaseModel for textures.         //
+//																	//
+//------------------------------------------------------------------//
+
+// Everything that can be shared between objects using the same model
+struct ModelAsset {
+    std::string path;
+    int refCount = 0;
+
+    // Loading state
+    bool queued = false;            // CPU preparation has been requested
+    bool prepared = false;          // CPU data is valid (set by the worker)
+    bool committed = false;         // GL buffers exist
+
+    ModelData data;                 // Skins are in bind pose, copied by every object
+    std::vector<PrimitiveObject> primitiveObjects;
+
+    // One vao, vertex and index buffer per model, primitives are ranges of them
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+
+    // Joint matrices of the bind pose, read by every object that is not animated
+    GLuint bindPoseBuffer = 0;
+};
+
+struct TextureAsset {
+    std::string path;
+    int refCount = 0;
+
+    ImageData image;                // Decoded pixels until the upload
+    GLuint textureID = 0;
+};
+
+ModelAsset *acquireModel(const char *filename);
+void releaseModel(ModelAsset *asset);
+
+TextureAsset *acquireTexture(const char *texturePath, ThreadPool *pool = NULL);
+GLuint commitTexture(TextureAsset *asset);
+void releaseTexture(TextureAsset *asset);
+
+#endif //ASSETCACHE_H
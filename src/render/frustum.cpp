@@ -0,0 +1,179 @@
+#include "frustum.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+// Screen radius in pixels under which each coarser level is used, and how far past it the radius must go to switch
+// The last level is the impostor one
+static const float lodThresholds[] = {150.0f, 60.0f, 25.0f, 12.0f};
+static const float lodHysteresis = 0.15f;
+
+void SphereSet::resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	radius.resize(count);
+}
+
+void SphereSet::set(size_t i, glm::vec3 center, float sphereRadius)
+{
+	x[i] = center.x;
+	y[i] = center.y;
+	z[i] = center.z;
+	radius[i] = sphereRadius;
+}
+
+// The radius grows with the largest scale of the matrix so the sphere still holds the model
+void SphereSet::setTransformed(size_t i, const glm::mat4 &model, glm::vec3 center, float sphereRadius)
+{
+	set(i, glm::vec3(model * glm::vec4(center, 1.0f)), sphereRadius * matrixScale(model));
+}
+
+float matrixScale(const glm::mat4 &model)
+{
+	return std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+}
+
+// Rows of the matrix added and subtracted (Gribb and Hartmann), glm is column major
+Frustum frustumFromMatrix(const glm::mat4 &viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];     // Left
+	frustum.planes[1] = rows[3] - rows[0];     // Right
+	frustum.planes[2] = rows[3] + rows[1];     // Bottom
+	frustum.planes[3] = rows[3] - rows[1];     // Top
+	frustum.planes[4] = rows[3] + rows[2];     // Near
+	frustum.planes[5] = rows[3] - rows[2];     // Far
+
+	for (int i = 0; i < 6; i++)
+	{
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	}
+	return frustum;
+}
+
+static bool sphereInFrustum(const Frustum &frustum, float x, float y, float z, float radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void cullSpheres(const Frustum &frustum, const SphereSet &spheres, std::vector<GLuint> &survivors)
+{
+	survivors.clear();
+
+	size_t count = spheres.size();
+	size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+		// A sphere is out as soon as it is fully behind one plane
+		__m128 inside = _mm_cmpeq_ps(x, x);
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+										 _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				survivors.push_back(i + lane);
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		if (sphereInFrustum(frustum, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]))
+		{
+			survivors.push_back(i);
+		}
+	}
+}
+
+// Closest first so the depth test rejects what is behind before it is shaded
+void sortFrontToBack(const SphereSet &spheres, glm::vec3 viewer, std::vector<GLuint> &survivors)
+{
+	std::vector<std::pair<float, GLuint> > distances(survivors.size());
+	for (size_t i = 0; i < survivors.size(); i++)
+	{
+		GLuint s = survivors[i];
+		glm::vec3 offset = glm::vec3(spheres.x[s], spheres.y[s], spheres.z[s]) - viewer;
+		distances[i] = std::make_pair(glm::dot(offset, offset), s);
+	}
+
+	std::sort(distances.begin(), distances.end());
+	for (size_t i = 0; i < survivors.size(); i++)
+	{
+		survivors[i] = distances[i].second;
+	}
+}
+
+static GLuint lodForRadius(float screenRadius)
+{
+	GLuint level = 0;
+	while (level < sizeof(lodThresholds) / sizeof(lodThresholds[0]) && screenRadius < lodThresholds[level])
+	{
+		level++;
+	}
+	return level;
+}
+
+// Coarser only if the radius is small enough with some margin, finer only if it is large enough with some margin
+GLuint selectLod(float screenRadius, GLuint current)
+{
+	GLuint coarser = lodForRadius(screenRadius * (1.0f + lodHysteresis));
+	GLuint finer = lodForRadius(screenRadius * (1.0f - lodHysteresis));
+	if (coarser > current)
+	{
+		return coarser;
+	}
+	if (finer < current)
+	{
+		return finer;
+	}
+	return current;
+}
+
+// Every pass calls it with the same eye, the levels of the instances seen by both only change once
+void selectLods(const SphereSet &spheres, const std::vector<GLuint> &survivors, glm::vec3 eye, float lodScale, std::vector<unsigned char> &lods)
+{
+	for (size_t i = 0; i < survivors.size(); i++)
+	{
+		GLuint s = survivors[i];
+		glm::vec3 offset = glm::vec3(spheres.x[s], spheres.y[s], spheres.z[s]) - eye;
+		float distance = std::max(glm::length(offset), spheres.radius[s]);
+		float screenRadius = (distance > 0.0f) ? spheres.radius[s] * lodScale / distance : lodThresholds[0];
+		lods[s] = selectLod(screenRadius, lods[s]);
+	}
+}
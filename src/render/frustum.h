@@ -0,0 +1,54 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Bounding sphere culling against the frustum of a view       //
+//  projection matrix. Spheres are kept as separate x, y, z and     //
+//  radius arrays so four of them are tested per SSE instruction,   //
+//  a scalar loop does the rest (and everything without SSE).       //
+//																	//
+//      frustumFromMatrix : The six planes of a camera or light     //
+//          matrix, pointing inwards and normalised.                //
+//      SphereSet : Spheres of many instances, setTransformed puts  //
+//          a model space sphere through an instance matrix.        //
+//      cullSpheres : Fills survivors with the index of the spheres //
+//          touching the frustum, in order.                         //
+//      sortFrontToBack : Orders survivors by distance to viewer.   //
+//      selectLods : Level of detail of each survivor from the      //
+//          radius its sphere covers on screen, lodScale being the  //
+//          pixels of one unit seen at distance one. A level only   //
+//          changes once the radius is well past its threshold, so //
+//          objects on the edge do not switch every frame. The      //
+//          level after the coarsest mesh is for the impostors.     //
+//																	//
+//------------------------------------------------------------------//
+
+struct Frustum {
+    glm::vec4 planes[6];                // xyz normal, w distance
+};
+
+struct SphereSet {
+    std::vector<float> x, y, z, radius;
+
+    void resize(size_t count);
+    size_t size() const { return radius.size(); }
+    void set(size_t i, glm::vec3 center, float sphereRadius);
+    void setTransformed(size_t i, const glm::mat4 &model, glm::vec3 center, float sphereRadius);
+};
+
+Frustum frustumFromMatrix(const glm::mat4 &viewProjection);
+void cullSpheres(const Frustum &frustum, const SphereSet &spheres, std::vector<GLuint> &survivors);
+void sortFrontToBack(const SphereSet &spheres, glm::vec3 viewer, std::vector<GLuint> &survivors);
+
+// Levels of detail
+float matrixScale(const glm::mat4 &model);
+GLuint selectLod(float screenRadius, GLuint current);
+void selectLods(const SphereSet &spheres, const std::vector<GLuint> &survivors, glm::vec3 eye, float lodScale, std::vector<unsigned char> &lods);
+
+#endif //FRUSTUM_H
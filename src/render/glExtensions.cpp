@@ -0,0 +1,89 @@
+#include "glExtensions.h"
+
+#include <set>
+#include <string>
+
+GetProgramBinaryProc ext_glGetProgramBinary = NULL;
+ProgramBinaryProc ext_glProgramBinary = NULL;
+ProgramParameteriProc ext_glProgramParameteri = NULL;
+MaxShaderCompilerThreadsProc ext_glMaxShaderCompilerThreads = NULL;
+MultiDrawElementsIndirectProc ext_glMultiDrawElementsIndirect = NULL;
+static bool baseInstance = false;
+
+void loadGLExtensions(GLADloadfunc load)
+{
+	// Functions are only taken if the driver says it supports them, a non NULL pointer is not a proof
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	if (hasGLExtension("GL_ARB_get_program_binary") || major > 4 || (major == 4 && minor >= 1))
+	{
+		ext_glGetProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+		ext_glProgramBinary = (ProgramBinaryProc)load("glProgramBinary");
+		ext_glProgramParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+	}
+
+	if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+	{
+		ext_glMaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+	}
+	else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+	{
+		ext_glMaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+	}
+
+	if (hasGLExtension("GL_ARB_multi_draw_indirect") || major > 4 || (major == 4 && minor >= 3))
+	{
+		ext_glMultiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+	}
+
+	// Only changes what the indirect commands may hold, no function to load
+	baseInstance = hasGLExtension("GL_ARB_base_instance") || major > 4 || (major == 4 && minor >= 2);
+}
+
+bool hasGLExtension(const char *name)
+{
+	static std::set<std::string> extensions;
+	static bool listed = false;
+
+	if (!listed)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const GLubyte *extension = glGetStringi(GL_EXTENSIONS, i);
+			if (extension != NULL)
+			{
+				extensions.insert(reinterpret_cast<const char *>(extension));
+			}
+		}
+		listed = true;
+	}
+
+	return extensions.count(name) > 0;
+}
+
+bool hasProgramBinary()
+{
+	if (ext_glGetProgramBinary == NULL || ext_glProgramBinary == NULL || ext_glProgramParameteri == NULL)
+	{
+		return false;
+	}
+
+	// Some drivers expose the functions without any format to save to
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+bool hasMultiDrawIndirect()
+{
+	return ext_glMultiDrawElementsIndirect != NULL;
+}
+
+bool hasBaseInstance()
+{
+	return baseInstance;
+}
@@ -0,0 +1,64 @@
+#include <glad/gl.h>
+
+#ifndef GLEXTENSIONS_H
+#define GLEXTENSIONS_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Our glad loader only exposes the GL 3.3 core profile, the   //
+//  optional features we can use are checked here at runtime and    //
+//  their missing enums and functions are defined by hand.          //
+//																	//
+//      loadGLExtensions : Fetches the optional functions, call it  //
+//          right after gladLoadGL with the same loader.            //
+//      hasGLExtension : True if the driver lists the extension,    //
+//          the list is read once, needs the GL context.            //
+//      hasProgramBinary : glGetProgramBinary can be used.          //
+//      hasBaseInstance : Indirect commands may set baseInstance,   //
+//          it is reserved (zero) without GL_ARB_base_instance.     //
+//																	//
+//------------------------------------------------------------------//
+
+// GL_EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// GL_ARB_get_program_binary (core in 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (GLAD_API_PTR *GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (GLAD_API_PTR *ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (GLAD_API_PTR *ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+extern GetProgramBinaryProc ext_glGetProgramBinary;
+extern ProgramBinaryProc ext_glProgramBinary;
+extern ProgramParameteriProc ext_glProgramParameteri;
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile
+typedef void (GLAD_API_PTR *MaxShaderCompilerThreadsProc)(GLuint count);
+extern MaxShaderCompilerThreadsProc ext_glMaxShaderCompilerThreads;
+
+// GL_ARB_multi_draw_indirect (core in 4.3), the commands are read from GL_DRAW_INDIRECT_BUFFER (4.0)
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+typedef void (GLAD_API_PTR *MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+extern MultiDrawElementsIndirectProc ext_glMultiDrawElementsIndirect;
+
+void loadGLExtensions(GLADloadfunc load);
+bool hasGLExtension(const char *name);
+bool hasProgramBinary();
+bool hasMultiDrawIndirect();
+bool hasBaseInstance();
+
+#endif //GLEXTENSIONS_H
@@ -0,0 +1,270 @@
+#include "glState.h"
+
+#include <cstring>
+
+// Units and uniform binding points we remember, calls past them go straight to the driver
+static const int maxTextureUnits = 32;
+static const int maxUniformBindings = 64;
+
+struct UniformBinding
+{
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;            // -1 for glBindBufferBase
+};
+
+struct GLStateCache
+{
+	GLuint program;
+	GLuint vertexArray;
+	GLenum activeTexture;
+	GLuint textures2D[maxTextureUnits];
+	GLuint texturesCube[maxTextureUnits];
+	UniformBinding uniformBuffers[maxUniformBindings];
+};
+
+static GLStateCache state;
+static GLStateCounters counters;
+static GLStateCounters lastFrame;
+
+// Driver entry points
+static PFNGLUSEPROGRAMPROC driverUseProgram = NULL;
+static PFNGLBINDVERTEXARRAYPROC driverBindVertexArray = NULL;
+static PFNGLACTIVETEXTUREPROC driverActiveTexture = NULL;
+static PFNGLBINDTEXTUREPROC driverBindTexture = NULL;
+static PFNGLBINDBUFFERBASEPROC driverBindBufferBase = NULL;
+static PFNGLBINDBUFFERRANGEPROC driverBindBufferRange = NULL;
+static PFNGLDELETEPROGRAMPROC driverDeleteProgram = NULL;
+static PFNGLDELETEVERTEXARRAYSPROC driverDeleteVertexArrays = NULL;
+static PFNGLDELETETEXTURESPROC driverDeleteTextures = NULL;
+static PFNGLDELETEBUFFERSPROC driverDeleteBuffers = NULL;
+
+// Returns true when the call must go through
+static bool changes(bool changed)
+{
+	if (changed)
+	{
+		counters.issued++;
+	}
+	else
+	{
+		counters.filtered++;
+	}
+	return changed;
+}
+
+static void GLAD_API_PTR cachedUseProgram(GLuint program)
+{
+	if (changes(state.program != program))
+	{
+		state.program = program;
+		driverUseProgram(program);
+	}
+}
+
+static void GLAD_API_PTR cachedBindVertexArray(GLuint array)
+{
+	if (changes(state.vertexArray != array))
+	{
+		state.vertexArray = array;
+		driverBindVertexArray(array);
+	}
+}
+
+static void GLAD_API_PTR cachedActiveTexture(GLenum texture)
+{
+	if (changes(state.activeTexture != texture))
+	{
+		state.activeTexture = texture;
+		driverActiveTexture(texture);
+	}
+}
+
+static void GLAD_API_PTR cachedBindTexture(GLenum target, GLuint texture)
+{
+	int unit = state.activeTexture - GL_TEXTURE0;
+	GLuint *bound = NULL;
+	if (unit >= 0 && unit < maxTextureUnits)
+	{
+		if (target == GL_TEXTURE_2D)
+		{
+			bound = &state.textures2D[unit];
+		}
+		else if (target == GL_TEXTURE_CUBE_MAP)
+		{
+			bound = &state.texturesCube[unit];
+		}
+	}
+
+	if (bound == NULL)
+	{
+		counters.issued++;
+		driverBindTexture(target, texture);
+		return;
+	}
+
+	if (changes(*bound != texture))
+	{
+		*bound = texture;
+		driverBindTexture(target, texture);
+	}
+}
+
+static bool uniformBindingChanges(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (target != GL_UNIFORM_BUFFER || index >= (GLuint)maxUniformBindings)
+	{
+		counters.issued++;
+		return true;
+	}
+
+	UniformBinding &binding = state.uniformBuffers[index];
+	if (!changes(binding.buffer != buffer || binding.offset != offset || binding.size != size))
+	{
+		return false;
+	}
+
+	binding.buffer = buffer;
+	binding.offset = offset;
+	binding.size = size;
+	return true;
+}
+
+static void GLAD_API_PTR cachedBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	if (uniformBindingChanges(target, index, buffer, 0, -1))
+	{
+		driverBindBufferBase(target, index, buffer);
+	}
+}
+
+static void GLAD_API_PTR cachedBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (uniformBindingChanges(target, index, buffer, offset, size))
+	{
+		driverBindBufferRange(target, index, buffer, offset, size);
+	}
+}
+
+// Deleted names are unbound by GL and may come back from glGen*, forget them
+static void GLAD_API_PTR cachedDeleteProgram(GLuint program)
+{
+	if (state.program == program)
+	{
+		state.program = 0;
+	}
+	driverDeleteProgram(program);
+}
+
+static void GLAD_API_PTR cachedDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (arrays[i] != 0 && state.vertexArray == arrays[i])
+		{
+			state.vertexArray = 0;
+		}
+	}
+	driverDeleteVertexArrays(n, arrays);
+}
+
+static void GLAD_API_PTR cachedDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		for (int unit = 0; unit < maxTextureUnits; unit++)
+		{
+			if (textures[i] != 0 && state.textures2D[unit] == textures[i])
+			{
+				state.textures2D[unit] = 0;
+			}
+			if (textures[i] != 0 && state.texturesCube[unit] == textures[i])
+			{
+				state.texturesCube[unit] = 0;
+			}
+		}
+	}
+	driverDeleteTextures(n, textures);
+}
+
+static void GLAD_API_PTR cachedDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		for (int index = 0; index < maxUniformBindings; index++)
+		{
+			if (buffers[i] != 0 && state.uniformBuffers[index].buffer == buffers[i])
+			{
+				state.uniformBuffers[index].buffer = 0;
+				state.uniformBuffers[index].offset = 0;
+				state.uniformBuffers[index].size = -1;
+			}
+		}
+	}
+	driverDeleteBuffers(n, buffers);
+}
+
+void invalidateGLState()
+{
+	memset(&state, 0, sizeof(state));
+	state.activeTexture = GL_TEXTURE0;
+	for (int index = 0; index < maxUniformBindings; index++)
+	{
+		state.uniformBuffers[index].size = -1;
+	}
+
+	// Ask the driver for what cannot be assumed, the rest starts at the GL defaults
+	if (driverUseProgram != NULL)
+	{
+		GLint value = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+		state.program = value;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+		state.vertexArray = value;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+		state.activeTexture = value;
+	}
+}
+
+void installGLStateCache()
+{
+	if (driverUseProgram != NULL)
+	{
+		return;
+	}
+
+	driverUseProgram = glad_glUseProgram;
+	driverBindVertexArray = glad_glBindVertexArray;
+	driverActiveTexture = glad_glActiveTexture;
+	driverBindTexture = glad_glBindTexture;
+	driverBindBufferBase = glad_glBindBufferBase;
+	driverBindBufferRange = glad_glBindBufferRange;
+	driverDeleteProgram = glad_glDeleteProgram;
+	driverDeleteVertexArrays = glad_glDeleteVertexArrays;
+	driverDeleteTextures = glad_glDeleteTextures;
+	driverDeleteBuffers = glad_glDeleteBuffers;
+
+	invalidateGLState();
+
+	glad_glUseProgram = cachedUseProgram;
+	glad_glBindVertexArray = cachedBindVertexArray;
+	glad_glActiveTexture = cachedActiveTexture;
+	glad_glBindTexture = cachedBindTexture;
+	glad_glBindBufferBase = cachedBindBufferBase;
+	glad_glBindBufferRange = cachedBindBufferRange;
+	glad_glDeleteProgram = cachedDeleteProgram;
+	glad_glDeleteVertexArrays = cachedDeleteVertexArrays;
+	glad_glDeleteTextures = cachedDeleteTextures;
+	glad_glDeleteBuffers = cachedDeleteBuffers;
+}
+
+void beginGLStateFrame()
+{
+	lastFrame = counters;
+	counters = GLStateCounters();
+}
+
+const GLStateCounters &glStateLastFrame()
+{
+	return lastFrame;
+}
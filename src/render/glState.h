@@ -0,0 +1,39 @@
+#include <glad/gl.h>
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Redundant bind filter. The glad pointers of the binding     //
+//  calls are swapped for wrappers that remember the bound state    //
+//  and drop calls that would not change it, so the rest of the     //
+//  code keeps calling glUseProgram, glBindTexture... as usual.     //
+//																	//
+//  Filtered : glUseProgram, glBindVertexArray, glActiveTexture,    //
+//      glBindTexture (2D and cube maps), glBindBufferBase and      //
+//      glBindBufferRange on uniform buffers. Deleting an object    //
+//      forgets it, so a recycled name is bound again.              //
+//																	//
+//      installGLStateCache : Call once, right after gladLoadGL.    //
+//      beginGLStateFrame : Saves the counters of the frame that    //
+//          ended in lastFrame and starts new ones.                 //
+//      invalidateGLState : Forget everything, for code that binds  //
+//          behind our back (none for now).                         //
+//																	//
+//------------------------------------------------------------------//
+
+struct GLStateCounters
+{
+    unsigned long issued = 0;       // Calls that reached the driver
+    unsigned long filtered = 0;     // Calls dropped because nothing changed
+};
+
+void installGLStateCache();
+void beginGLStateFrame();
+void invalidateGLState();
+
+// Counters of the last complete frame
+const GLStateCounters &glStateLastFrame();
+
+#endif //GLSTATE_H
@@ -0,0 +1,86 @@
+#include "mappedFile.h"
+
+#include <fstream>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data(NULL), size(0) {}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// The mapping keeps its own reference to the file
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data = static_cast<const unsigned char *>(mapping);
+	size = info.st_size;
+#else
+	std::ifstream stream(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!stream.is_open())
+	{
+		return false;
+	}
+
+	fallback.resize(stream.tellg());
+	stream.seekg(0);
+	stream.read(reinterpret_cast<char *>(fallback.data()), fallback.size());
+
+	data = fallback.data();
+	size = fallback.size();
+#endif
+	return size > 0;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+	if (data != NULL)
+	{
+		munmap(const_cast<unsigned char *>(data), size);
+	}
+#endif
+	fallback.clear();
+	fallback.shrink_to_fit();
+
+	data = NULL;
+	size = 0;
+}
+
+bool isBakeUpToDate(const char *bakedPath, const char *sourcePath)
+{
+	struct stat sourceInfo, bakedInfo;
+	if (stat(bakedPath, &bakedInfo) != 0)
+	{
+		return false;
+	}
+	return stat(sourcePath, &sourceInfo) != 0 || bakedInfo.st_mtime >= sourceInfo.st_mtime;
+}
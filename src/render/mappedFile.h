@@ -0,0 +1,40 @@
+#include <cstddef>
+#include <vector>
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Read only view of a whole file. On POSIX systems the file   //
+//  is mmap'd so pages are only read when touched, elsewhere it is  //
+//  read in memory. The data stays valid until close is called.     //
+//																	//
+//      isBakeUpToDate : True if the baked file exists and is not   //
+//          older than its source (or the source is gone).          //
+//																	//
+//------------------------------------------------------------------//
+
+struct MappedFile {
+
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *path);
+    void close();
+
+    const unsigned char *data;
+    size_t size;
+
+    // Read fallback when mmap is not available
+    std::vector<unsigned char> fallback;
+
+private:
+    // Owns the mapping, never copied
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+bool isBakeUpToDate(const char *bakedPath, const char *sourcePath);
+
+#endif //MAPPEDFILE_H
@@ -0,0 +1,564 @@
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+//---- Welding ----
+
+void weldVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	// Vertex has no padding and is zeroed when built, comparing the raw bytes is safe
+	std::unordered_map<std::string, uint32_t> unique;
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		std::string key(reinterpret_cast<const char *>(&vertices[i]), sizeof(Vertex));
+		std::unordered_map<std::string, uint32_t>::iterator it = unique.find(key);
+		if (it != unique.end()) {
+			remap[i] = it->second;
+		} else {
+			remap[i] = welded.size();
+			unique[key] = welded.size();
+			welded.push_back(vertices[i]);
+		}
+	}
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		indices[i] = remap[indices[i]];
+	}
+	vertices.swap(welded);
+}
+
+//---- Vertex cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation") ----
+
+static const int forsythCacheSize = 32;
+
+static float forsythScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		// The last triangle's vertices get a fixed score so the next one does not reuse them in the same order
+		if (cachePosition < 3) {
+			score = 0.75f;
+		} else {
+			score = powf(1.0f - (cachePosition - 3) / float(forsythCacheSize - 3), 1.5f);
+		}
+	}
+
+	// Vertices with few triangles left are finished first, so they leave the cache sooner
+	score += 2.0f * powf((float)remainingTriangles, -0.5f);
+	return score;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles using each vertex, the first "remaining" ones are not emitted yet
+	std::vector<int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		remaining[indices[i]]++;
+	}
+	std::vector<int> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	std::vector<int> vertexTriangles(offsets[vertexCount]);
+	std::vector<int> filled(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = indices[t * 3 + k];
+			vertexTriangles[offsets[v] + filled[v]++] = t;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		vertexScore[v] = forsythScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++) {
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+
+	std::vector<int> cache, nextCache;
+	int bestTriangle = -1;
+	size_t scanStart = 0;
+
+	for (size_t i = 0; i < triangleCount; i++) {
+		// Nothing usable in the cache, take the best remaining triangle
+		if (bestTriangle < 0) {
+			float bestScore = -1.0f;
+			while (scanStart < triangleCount && emitted[scanStart]) {
+				scanStart++;
+			}
+			for (size_t t = scanStart; t < triangleCount; t++) {
+				if (!emitted[t] && triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		emitted[bestTriangle] = true;
+		const uint32_t *triangle = &indices[bestTriangle * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+
+		// The triangle is done for its vertices
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			int *begin = &vertexTriangles[offsets[v]];
+			int *end = begin + remaining[v];
+			int *found = std::find(begin, end, bestTriangle);
+			std::swap(*found, *(end - 1));
+			remaining[v]--;
+		}
+
+		// Its vertices go to the front of the cache, the ones pushed past the end are evicted
+		nextCache.assign(triangle, triangle + 3);
+		for (size_t c = 0; c < cache.size(); c++) {
+			int v = cache[c];
+			if (v != (int)triangle[0] && v != (int)triangle[1] && v != (int)triangle[2]) {
+				nextCache.push_back(v);
+			}
+		}
+		cache.swap(nextCache);
+
+		// Rescore the cache content and their triangles, the best one is played next
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t c = 0; c < cache.size(); c++) {
+			int v = cache[c];
+			cachePosition[v] = (c < (size_t)forsythCacheSize) ? c : -1;
+
+			float score = forsythScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			for (int r = 0; r < remaining[v]; r++) {
+				int t = vertexTriangles[offsets[v] + r];
+				triangleScore[t] += delta;
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+		if (cache.size() > (size_t)forsythCacheSize) {
+			cache.resize(forsythCacheSize);
+		}
+	}
+
+	indices.swap(result);
+}
+
+//---- Overdraw (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw") ----
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+	float inputACMR = computeACMR(indices, vertices.size());
+
+	// Clusters start where the cache optimized order flushes the cache (a triangle with 3 misses)
+	std::vector<size_t> clusterStarts;
+	std::vector<int> insertedAt(vertices.size(), -1);
+	int time = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = indices[t * 3 + k];
+			if (insertedAt[v] < 0 || time - insertedAt[v] >= (int)vertexCacheSize) {
+				insertedAt[v] = time++;
+				misses++;
+			}
+		}
+		if (misses == 3) {
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Mesh centroid, area weighted
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t t = 0; t < triangleCount; t++) {
+		const glm::vec3 &a = vertices[indices[t * 3]].position;
+		const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+		const glm::vec3 &c = vertices[indices[t * 3 + 2]].position;
+		float area = glm::length(glm::cross(b - a, c - a));
+		meshCentroid += (a + b + c) / 3.0f * area;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters facing away from the centroid are likely to occlude the others, they are drawn first
+	std::vector<std::pair<float, size_t> > order;
+	for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const glm::vec3 &a = vertices[indices[t * 3]].position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3 &d = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(cross);
+			centroid += (a + b + d) / 3.0f * triangleArea;
+			normal += cross;
+			area += triangleArea;
+		}
+		if (area > 0.0f) {
+			centroid /= area;
+		}
+		float normalLength = glm::length(normal);
+		float key = (normalLength > 0.0f) ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+		order.push_back(std::make_pair(-key, c));
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		size_t c = order[i].second;
+		result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+
+	// Only keep it if the cache efficiency did not suffer too much
+	if (computeACMR(result, vertices.size()) <= inputACMR * threshold) {
+		indices.swap(result);
+	}
+}
+
+//---- Vertex fetch ----
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	std::vector<int> remap(vertices.size(), -1);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		uint32_t v = indices[i];
+		if (remap[v] < 0) {
+			remap[v] = ordered.size();
+			ordered.push_back(vertices[v]);
+		}
+		indices[i] = remap[v];
+	}
+	vertices.swap(ordered);
+}
+
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	weldVertices(vertices, indices);
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, vertices);
+	optimizeVertexFetch(vertices, indices);
+}
+
+//---- Simplification (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics") ----
+
+// Sum of the squared distances to a set of planes, a symmetric 4x4 matrix
+struct Quadric {
+	float a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+static Quadric planeQuadric(glm::vec3 normal, float distance, float weight)
+{
+	Quadric q;
+	q.a2 = weight * normal.x * normal.x;
+	q.ab = weight * normal.x * normal.y;
+	q.ac = weight * normal.x * normal.z;
+	q.ad = weight * normal.x * distance;
+	q.b2 = weight * normal.y * normal.y;
+	q.bc = weight * normal.y * normal.z;
+	q.bd = weight * normal.y * distance;
+	q.c2 = weight * normal.z * normal.z;
+	q.cd = weight * normal.z * distance;
+	q.d2 = weight * distance * distance;
+	return q;
+}
+
+static void addQuadric(Quadric &q, const Quadric &other)
+{
+	q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+	q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+	q.c2 += other.c2; q.cd += other.cd;
+	q.d2 += other.d2;
+}
+
+static float quadricError(const Quadric &q, glm::vec3 p)
+{
+	return q.a2 * p.x * p.x + 2.0f * q.ab * p.x * p.y + 2.0f * q.ac * p.x * p.z + 2.0f * q.ad * p.x
+		+ q.b2 * p.y * p.y + 2.0f * q.bc * p.y * p.z + 2.0f * q.bd * p.y
+		+ q.c2 * p.z * p.z + 2.0f * q.cd * p.z
+		+ q.d2;
+}
+
+struct Collapse {
+	float error;
+	uint32_t from;
+	uint32_t to;
+
+	bool operator<(const Collapse &other) const { return error < other.error; }
+};
+
+// Vertices are grouped by position, a collapse moves every vertex of one position onto the other
+struct SimplifyState {
+	const std::vector<Vertex> &vertices;
+	std::vector<uint32_t> positionOf;               // First vertex with the same position
+	std::vector<std::vector<uint32_t> > members;    // Vertices of each position, on its first vertex
+	std::vector<std::vector<uint32_t> > around;     // Triangles touching each position
+	std::vector<Quadric> quadrics;
+	std::vector<bool> locked;
+
+	SimplifyState(const std::vector<Vertex> &vertices) : vertices(vertices) {}
+
+	glm::vec3 position(uint32_t v) const { return vertices[v].position; }
+};
+
+static bool triangleHasPosition(const SimplifyState &state, const std::vector<uint32_t> &indices, uint32_t t, uint32_t position)
+{
+	return state.positionOf[indices[t * 3]] == position || state.positionOf[indices[t * 3 + 1]] == position
+		|| state.positionOf[indices[t * 3 + 2]] == position;
+}
+
+// Moving "from" must not turn any of the triangles that stay around
+static bool collapseFlips(const SimplifyState &state, const std::vector<uint32_t> &indices, uint32_t from, uint32_t to)
+{
+	const std::vector<uint32_t> &triangles = state.around[from];
+	for (size_t i = 0; i < triangles.size(); i++) {
+		uint32_t t = triangles[i];
+		if (triangleHasPosition(state, indices, t, to)) {
+			continue;
+		}
+
+		glm::vec3 corners[3], moved[3];
+		for (int k = 0; k < 3; k++) {
+			corners[k] = state.position(indices[t * 3 + k]);
+			moved[k] = (state.positionOf[indices[t * 3 + k]] == from) ? state.position(to) : corners[k];
+		}
+		glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+		if (glm::dot(before, after) <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// A vertex goes on the vertex of the other position it shares an edge with, else on the one with the closest attributes
+static uint32_t collapseTarget(const SimplifyState &state, const std::vector<uint32_t> &indices, uint32_t vertex, uint32_t to)
+{
+	const std::vector<uint32_t> &triangles = state.around[state.positionOf[vertex]];
+	for (size_t i = 0; i < triangles.size(); i++) {
+		const uint32_t *corners = &indices[triangles[i] * 3];
+		if (corners[0] != vertex && corners[1] != vertex && corners[2] != vertex) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			if (state.positionOf[corners[k]] == to) {
+				return corners[k];
+			}
+		}
+	}
+
+	const Vertex &source = state.vertices[vertex];
+	const std::vector<uint32_t> &candidates = state.members[to];
+	uint32_t best = candidates[0];
+	float bestScore = -1e30f;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const Vertex &candidate = state.vertices[candidates[i]];
+		float score = glm::dot(source.normal, candidate.normal) - glm::length(source.uv - candidate.uv);
+		if (score > bestScore) {
+			bestScore = score;
+			best = candidates[i];
+		}
+	}
+	return best;
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, size_t targetIndexCount)
+{
+	SimplifyState state(vertices);
+
+	// Same position, whatever the other attributes
+	state.positionOf.resize(vertices.size());
+	state.members.resize(vertices.size());
+	std::unordered_map<std::string, uint32_t> positions;
+	for (size_t v = 0; v < vertices.size(); v++) {
+		std::string key(reinterpret_cast<const char *>(&vertices[v].position), sizeof(glm::vec3));
+		std::unordered_map<std::string, uint32_t>::iterator it = positions.find(key);
+		state.positionOf[v] = (it != positions.end()) ? it->second : (positions[key] = v);
+		state.members[state.positionOf[v]].push_back(v);
+	}
+
+	// Planes around each position, weighted by the triangle areas
+	Quadric zero = {};
+	state.quadrics.assign(vertices.size(), zero);
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		glm::vec3 p0 = vertices[indices[t]].position;
+		glm::vec3 normal = glm::cross(vertices[indices[t + 1]].position - p0, vertices[indices[t + 2]].position - p0);
+		float doubleArea = glm::length(normal);
+		if (doubleArea == 0.0f) {
+			continue;
+		}
+		normal /= doubleArea;
+		Quadric q = planeQuadric(normal, -glm::dot(normal, p0), doubleArea * 0.5f);
+		for (int k = 0; k < 3; k++) {
+			addQuadric(state.quadrics[state.positionOf[indices[t + k]]], q);
+		}
+	}
+
+	// Edges used by one triangle are borders, their positions stay so open models keep their outline
+	std::map<std::pair<uint32_t, uint32_t>, int> edgeUses;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = state.positionOf[indices[t + k]];
+			uint32_t b = state.positionOf[indices[t + (k + 1) % 3]];
+			edgeUses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+		}
+	}
+	state.locked.assign(vertices.size(), false);
+	for (std::map<std::pair<uint32_t, uint32_t>, int>::iterator it = edgeUses.begin(); it != edgeUses.end(); ++it) {
+		if (it->second == 1) {
+			state.locked[it->first.first] = true;
+			state.locked[it->first.second] = true;
+		}
+	}
+
+	std::vector<uint32_t> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	std::vector<uint32_t> remap(vertices.size());
+
+	// Each pass does the cheapest collapses that do not touch each other, until the target or nothing is left to do
+	while (result.size() > targetIndexCount) {
+		size_t triangleCount = result.size() / 3;
+		state.around.assign(vertices.size(), std::vector<uint32_t>());
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int k = 0; k < 3; k++) {
+				state.around[state.positionOf[result[t * 3 + k]]].push_back(t);
+			}
+		}
+
+		std::vector<Collapse> collapses;
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = state.positionOf[result[t * 3 + k]];
+				uint32_t b = state.positionOf[result[t * 3 + (k + 1) % 3]];
+				for (int direction = 0; direction < 2; direction++) {
+					uint32_t from = direction ? b : a;
+					uint32_t to = direction ? a : b;
+					if (state.locked[from]) {
+						continue;
+					}
+					Quadric q = state.quadrics[from];
+					addQuadric(q, state.quadrics[to]);
+					Collapse collapse = {quadricError(q, state.position(to)), from, to};
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		for (size_t v = 0; v < remap.size(); v++) {
+			remap[v] = v;
+		}
+		std::vector<bool> touched(vertices.size(), false);
+		size_t removedIndices = 0;
+		size_t collapsed = 0;
+
+		for (size_t c = 0; c < collapses.size() && result.size() - removedIndices > targetIndexCount; c++) {
+			uint32_t from = collapses[c].from;
+			uint32_t to = collapses[c].to;
+			if (touched[from] || touched[to] || collapseFlips(state, result, from, to)) {
+				continue;
+			}
+
+			for (size_t i = 0; i < state.members[from].size(); i++) {
+				uint32_t vertex = state.members[from][i];
+				remap[vertex] = collapseTarget(state, result, vertex, to);
+			}
+			state.members[from].clear();
+			addQuadric(state.quadrics[to], state.quadrics[from]);
+
+			// Everything around moved, its triangles are only looked at again on the next pass
+			const std::vector<uint32_t> &triangles = state.around[from];
+			for (size_t i = 0; i < triangles.size(); i++) {
+				for (int k = 0; k < 3; k++) {
+					touched[state.positionOf[result[triangles[i] * 3 + k]]] = true;
+				}
+				if (triangleHasPosition(state, result, triangles[i], to)) {
+					removedIndices += 3;
+				}
+			}
+			collapsed++;
+		}
+
+		if (collapsed == 0) {
+			break;
+		}
+
+		// Apply the moves and drop the triangles that lost their area
+		std::vector<uint32_t> kept;
+		kept.reserve(result.size() - removedIndices);
+		for (size_t t = 0; t < triangleCount; t++) {
+			uint32_t i0 = remap[result[t * 3]], i1 = remap[result[t * 3 + 1]], i2 = remap[result[t * 3 + 2]];
+			uint32_t p0 = state.positionOf[i0], p1 = state.positionOf[i1], p2 = state.positionOf[i2];
+			if (p0 == p1 || p1 == p2 || p2 == p0) {
+				continue;
+			}
+			kept.push_back(i0);
+			kept.push_back(i1);
+			kept.push_back(i2);
+		}
+		result.swap(kept);
+	}
+
+	return result;
+}
+
+//---- Statistics ----
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return 0.0f;
+	}
+
+	// FIFO cache, a vertex is in it if it was inserted less than cacheSize insertions ago
+	std::vector<int> insertedAt(vertexCount, -1);
+	int time = 0;
+	size_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		uint32_t v = indices[i];
+		if (insertedAt[v] < 0 || time - insertedAt[v] >= (int)cacheSize) {
+			insertedAt[v] = time++;
+			misses++;
+		}
+	}
+	return misses / float(triangleCount);
+}
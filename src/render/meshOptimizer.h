@@ -0,0 +1,52 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+// Other relevant structs
+#include "objects/commonStructs.h"
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Load-time mesh optimizations for indexed triangle lists.    //
+//  They only reorder (or weld) data, the rendered result stays     //
+//  the same, except for the simplifier that makes the LODs.        //
+//  Indices are relative to the given vertex array.                 //
+//																	//
+//      weldVertices : Merges the vertices that are exactly equal   //
+//      optimizeVertexCache : Forsyth's triangle reordering, for    //
+//          post-transform vertex cache reuse                       //
+//      optimizeOverdraw : Sorts clusters of the cache optimized    //
+//          order so the outer facing ones come first, only kept   //
+//          if the ACMR stays under threshold times the input one   //
+//      optimizeVertexFetch : Renumbers vertices in order of first  //
+//          use, drops the unused ones                              //
+//      optimizeMesh : All of the above, in that order              //
+//																	//
+//      simplifyMesh : Quadric error edge collapses until the index //
+//          count reaches the target (or nothing can collapse). It  //
+//          only gives new indices, the vertices are shared with    //
+//          the full mesh. Border edges stay where they are.        //
+//																	//
+//      computeACMR : Average cache miss ratio (misses/triangle)    //
+//          of a FIFO cache, between 0.5 (ideal) and 3              //
+//																	//
+//------------------------------------------------------------------//
+
+// Size of the simulated cache, close to what current GPUs reuse
+static const unsigned int vertexCacheSize = 16;
+
+void weldVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices, float threshold = 1.05f);
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, size_t targetIndexCount);
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize = vertexCacheSize);
+
+#endif //MESHOPTIMIZER_H
@@ -0,0 +1,203 @@
+#include "occlusionQueries.h"
+#include "shaderManager.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+
+// Corners of the unit cube, the boxes scale it
+static const GLfloat cubeVertices[24] = {
+	0.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 1.0f,   1.0f, 0.0f, 1.0f,   1.0f, 1.0f, 1.0f,   0.0f, 1.0f, 1.0f
+};
+
+// Face culling is off while the boxes are drawn, the winding does not matter
+static const GLubyte cubeIndices[36] = {
+	0, 1, 2,   0, 2, 3,     // Back
+	4, 5, 6,   4, 6, 7,     // Front
+	0, 4, 7,   0, 7, 3,     // Left
+	1, 5, 6,   1, 6, 2,     // Right
+	3, 2, 6,   3, 6, 7,     // Top
+	0, 1, 5,   0, 5, 4      // Bottom
+};
+
+void OcclusionQueries::init()
+{
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+
+	programID = getProgram(occlusionVertexPath, occlusionFragmentPath);
+	if (programID == 0)
+	{
+		std::cerr << "Failed to load occlusion shaders." << std::endl;
+	}
+	mvpID = getProgramReflection(programID).uniform("MVP");
+}
+
+void OcclusionQueries::cleanup()
+{
+	for (size_t i = 0; i < proxies.size(); i++)
+	{
+		if (proxies[i].used)
+		{
+			glDeleteQueries(2, proxies[i].queries);
+		}
+	}
+	proxies.clear();
+	tested.clear();
+
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	vao = vertexBuffer = indexBuffer = 0;
+}
+
+// Free slots are reused, their queries are made again
+int OcclusionQueries::createProxy()
+{
+	size_t proxy = 0;
+	while (proxy < proxies.size() && proxies[proxy].used)
+	{
+		proxy++;
+	}
+	if (proxy == proxies.size())
+	{
+		proxies.push_back(OcclusionProxy());
+	}
+
+	OcclusionProxy &slot = proxies[proxy];
+	glGenQueries(2, slot.queries);
+	slot.queriedFrame[0] = slot.queriedFrame[1] = 0;
+	slot.occluded = false;
+	slot.used = true;
+	return proxy;
+}
+
+void OcclusionQueries::destroyProxy(int proxy)
+{
+	if (proxy < 0 || proxy >= (int)proxies.size() || !proxies[proxy].used)
+	{
+		return;
+	}
+	glDeleteQueries(2, proxies[proxy].queries);
+	proxies[proxy].used = false;
+}
+
+void OcclusionQueries::beginFrame(glm::vec3 eye)
+{
+	this -> eye = eye;
+	frame++;
+	tested.clear();
+}
+
+// A box holding the eye has its faces clipped, its query would say hidden, it is not tested and its old results are dropped
+void OcclusionQueries::test(int proxy, const AABB &box)
+{
+	if (proxy < 0 || proxy >= (int)proxies.size())
+	{
+		return;
+	}
+
+	glm::vec3 margin = (box.max - box.min) * 0.01f + glm::vec3(0.01f);
+	OcclusionProxy &slot = proxies[proxy];
+	slot.box.min = box.min - margin;
+	slot.box.max = box.max + margin;
+
+	if (glm::all(glm::greaterThanEqual(eye, slot.box.min)) && glm::all(glm::lessThanEqual(eye, slot.box.max)))
+	{
+		slot.queriedFrame[0] = slot.queriedFrame[1] = 0;
+		slot.occluded = false;
+		return;
+	}
+	tested.push_back(proxy);
+}
+
+// Every box against the depth of the whole frame, the frame after uses the results
+void OcclusionQueries::runQueries(const glm::mat4 &viewProjection)
+{
+	if (tested.empty() || programID == 0)
+	{
+		return;
+	}
+
+	glUseProgram(programID);
+	glBindVertexArray(vao);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+
+	int parity = frame & 1;
+	for (size_t i = 0; i < tested.size(); i++)
+	{
+		OcclusionProxy &slot = proxies[tested[i]];
+		glm::mat4 mvp = viewProjection * glm::scale(glm::translate(glm::mat4(1.0f), slot.box.min), slot.box.max - slot.box.min);
+		glUniformMatrix4fv(mvpID, 1, GL_FALSE, &mvp[0][0]);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, slot.queries[parity]);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		slot.queriedFrame[parity] = frame;
+	}
+
+	glEnable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	tested.clear();
+}
+
+// NO_WAIT draws anyway if the GPU has not finished the query yet
+bool OcclusionQueries::beginConditional(int proxy)
+{
+	if (proxy < 0 || proxy >= (int)proxies.size())
+	{
+		return false;
+	}
+
+	int previous = (frame + 1) & 1;
+	const OcclusionProxy &slot = proxies[proxy];
+	if (slot.queriedFrame[previous] != frame - 1)
+	{
+		return false;
+	}
+	glBeginConditionalRender(slot.queries[previous], GL_QUERY_NO_WAIT);
+	return true;
+}
+
+// Only reads a result the driver already has, the last known one stays otherwise
+bool OcclusionQueries::isOccluded(int proxy)
+{
+	if (proxy < 0 || proxy >= (int)proxies.size())
+	{
+		return false;
+	}
+
+	int previous = (frame + 1) & 1;
+	OcclusionProxy &slot = proxies[proxy];
+	if (slot.queriedFrame[previous] != frame - 1)
+	{
+		slot.occluded = false;
+		return false;
+	}
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(slot.queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available)
+	{
+		GLuint samples = 0;
+		glGetQueryObjectuiv(slot.queries[previous], GL_QUERY_RESULT, &samples);
+		slot.occluded = (samples == 0);
+	}
+	return slot.occluded;
+}
@@ -0,0 +1,75 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "sceneBVH.h"
+
+#ifndef OCCLUSIONQUERIES_H
+#define OCCLUSIONQUERIES_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Hardware occlusion culling of whole objects. Once the       //
+//  opaque pass is done, the box of every object tested this frame  //
+//  is drawn (no color, no depth write) inside a GL_ANY_SAMPLES_    //
+//  PASSED query. The next frame only uses those results, either    //
+//  by the GPU through conditional rendering, or read back when     //
+//  they are already there, so the CPU never waits on a query.      //
+//  Each proxy has two queries used on every other frame. A proxy   //
+//  that was not tested last frame, or whose box holds the eye,     //
+//  is always drawn.                                                //
+//																	//
+//      init / cleanup : Box mesh and its program.                  //
+//      createProxy / destroyProxy : One per object.                //
+//      beginFrame : New frame seen from the eye, call before any   //
+//          test.                                                   //
+//      test : The object is drawn this frame, query its box.       //
+//      runQueries : After the opaque pass, draws the tested boxes. //
+//      beginConditional : Starts a conditional render on the last  //
+//          frame query, false if there is none (nothing to end).   //
+//      isOccluded : Last result read back, for the objects drawn   //
+//          with others (StaticBatch members).                      //
+//																	//
+//------------------------------------------------------------------//
+
+const char *const occlusionVertexPath = "../src/shaders/occlusion.vert";
+const char *const occlusionFragmentPath = "../src/shaders/occlusion.frag";
+
+struct OcclusionProxy {
+    GLuint queries[2];                  // Frame parity
+    unsigned long queriedFrame[2];      // Frame each one was issued, 0 if never
+    AABB box;                           // Slightly enlarged so flat objects do not hide themselves
+    bool occluded;                      // Last result read back
+    bool used;
+};
+
+struct OcclusionQueries {
+
+    void init();
+    void cleanup();
+
+    int createProxy();
+    void destroyProxy(int proxy);
+
+    void beginFrame(glm::vec3 eye);
+    void test(int proxy, const AABB &box);
+    void runQueries(const glm::mat4 &viewProjection);
+
+    bool beginConditional(int proxy);
+    bool isOccluded(int proxy);
+
+    std::vector<OcclusionProxy> proxies;
+    std::vector<int> tested;            // Boxes to draw at the end of this frame
+    glm::vec3 eye;
+    unsigned long frame = 1;
+
+    // Unit cube and the program drawing it
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint programID = 0;
+    GLint mvpID = -1;
+};
+
+#endif //OCCLUSIONQUERIES_H
@@ -0,0 +1,137 @@
+#include "renderQueue.h"
+
+#include <algorithm>
+
+// Field sizes, see the header
+static const int depthBits = 24;
+static const int vaoBits = 12;
+static const int textureBits = 12;
+static const int programBits = 12;
+
+static const int vaoShift = depthBits;
+static const int textureShift = vaoShift + vaoBits;
+static const int programShift = textureShift + textureBits;
+static const int passShift = programShift + programBits;
+
+uint64_t makeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth)
+{
+	const uint64_t depthMax = (1u << depthBits) - 1;
+	const uint64_t fieldMask = (1u << 12) - 1;
+
+	// GL names are small integers, two that collide in 12 bits are only grouped together, the draws stay right
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+	return ((uint64_t)pass << passShift)
+		| ((program & fieldMask) << programShift)
+		| ((texture & fieldMask) << textureShift)
+		| ((vao & fieldMask) << vaoShift)
+		| (uint64_t)(depth * depthMax);
+}
+
+RenderPass keyPass(uint64_t key)
+{
+	return (RenderPass)(key >> passShift);
+}
+
+void RenderQueue::submit(uint64_t key, void *object, DrawFunction draw)
+{
+	DrawPacket packet;
+	packet.key = key;
+	packet.object = object;
+	packet.draw = draw;
+	packets.push_back(packet);
+}
+
+// LSD radix sort, one byte at a time, bytes that are the same for every packet are skipped
+void RenderQueue::sort()
+{
+	unsortedChanges = countStateChanges();
+
+	scratch.resize(packets.size());
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {0};
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			counts[(packets[i].key >> shift) & 0xFF]++;
+		}
+
+		bool sameByte = false;
+		for (int b = 0; b < 256; b++)
+		{
+			if (counts[b] == packets.size())
+			{
+				sameByte = true;
+			}
+		}
+		if (sameByte)
+		{
+			continue;
+		}
+
+		size_t offsets[256];
+		size_t sum = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			offsets[b] = sum;
+			sum += counts[b];
+		}
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			scratch[offsets[(packets[i].key >> shift) & 0xFF]++] = packets[i];
+		}
+		packets.swap(scratch);
+	}
+
+	sortedChanges = countStateChanges();
+	drawCount = packets.size();
+}
+
+void RenderQueue::execute(RenderPass pass, const FrameContext &context)
+{
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		if (keyPass(packets[i].key) == pass)
+		{
+			packets[i].draw(packets[i].object, pass, context);
+		}
+	}
+}
+
+void RenderQueue::clear()
+{
+	packets.clear();
+}
+
+// What a naive renderer would rebind between two packets in the current order
+StateChanges RenderQueue::countStateChanges() const
+{
+	StateChanges changes;
+	const uint64_t fieldMask = (1u << 12) - 1;
+
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		uint64_t key = packets[i].key;
+		if (i == 0)
+		{
+			changes.programs++;
+			changes.textures++;
+			changes.vaos++;
+			continue;
+		}
+
+		uint64_t previous = packets[i - 1].key;
+		if (((key >> programShift) & fieldMask) != ((previous >> programShift) & fieldMask))
+		{
+			changes.programs++;
+		}
+		if (((key >> textureShift) & fieldMask) != ((previous >> textureShift) & fieldMask))
+		{
+			changes.textures++;
+		}
+		if (((key >> vaoShift) & fieldMask) != ((previous >> vaoShift) & fieldMask))
+		{
+			changes.vaos++;
+		}
+	}
+	return changes;
+}
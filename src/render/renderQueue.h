@@ -0,0 +1,96 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Objects no longer draw themselves in the order main calls   //
+//  them, they submit a packet with a 64 bits sort key and the      //
+//  queue draws everything sorted, so objects sharing a program,    //
+//  a texture or a vao follow each other and opaque draws go front  //
+//  to back inside each group.                                      //
+//																	//
+//  Key, from the most significant bits :                           //
+//      pass (4) | program (12) | texture (12) | vao (12) | depth (24)
+//																	//
+//      makeSortKey : Builds a key, depth is in [0,1] (0 closest).  //
+//      submit : Adds a packet, the callback draws it.              //
+//      sort : Radix sort of the packets by key.                    //
+//      execute : Draws the packets of one pass, in order.          //
+//      clear : Empties the queue for the next frame.               //
+//																	//
+//  Counters tell how many program, texture and vao changes the     //
+//  frame needed, sorted and in submission order, to compare.       //
+//																	//
+//------------------------------------------------------------------//
+
+struct SoftOcclusion;
+
+enum RenderPass
+{
+    passDepth = 0,      // Shadow map
+    passOpaque = 1,     // Main view
+    passPrepass = 2,    // Depth of the main view before passOpaque, draws what it kept
+    passStaticDepth = 3 // Shadow map of the static casters, cached until the light or them change
+};
+
+// Everything a packet may need to draw itself, filled once per frame
+struct FrameContext
+{
+    glm::mat4 cameraMatrix;         // View projection of the camera
+    glm::mat4 lightMatrix;          // View projection of the light
+    glm::vec3 eye;
+    glm::vec3 lightPosition;
+    glm::vec3 lightIntensity;
+    GLuint depthTexture = 0;
+    float lodScale = 0.0f;          // Pixels covered by one unit at distance one, for the levels of detail
+    const SoftOcclusion *softOcclusion = NULL;  // Rendered for the camera, NULL when the CPU occlusion is off
+    bool depthPrepass = false;      // Opaque draws are queued depth only in passPrepass too
+    bool staticShadowsDirty = true; // Static casters are queued in passStaticDepth, their cached map is used otherwise
+};
+
+typedef void (*DrawFunction)(void *object, RenderPass pass, const FrameContext &context);
+
+struct DrawPacket
+{
+    uint64_t key;
+    void *object;
+    DrawFunction draw;
+};
+
+struct StateChanges
+{
+    unsigned int programs = 0;
+    unsigned int textures = 0;
+    unsigned int vaos = 0;
+
+    unsigned int total() const { return programs + textures + vaos; }
+};
+
+uint64_t makeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth);
+RenderPass keyPass(uint64_t key);
+
+struct RenderQueue {
+
+    void submit(uint64_t key, void *object, DrawFunction draw);
+    void sort();
+    void execute(RenderPass pass, const FrameContext &context);
+    void clear();
+
+    StateChanges countStateChanges() const;
+
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> scratch;        // Radix sort buffer, kept between frames
+
+    // Counters of the last sorted frame
+    unsigned int drawCount = 0;
+    StateChanges unsortedChanges;
+    StateChanges sortedChanges;
+};
+
+#endif //RENDERQUEUE_H
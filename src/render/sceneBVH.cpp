@@ -0,0 +1,528 @@
+#include "sceneBVH.h"
+
+#include <algorithm>
+
+AABB mergeBoxes(const AABB &a, const AABB &b)
+{
+	AABB box;
+	box.min = glm::min(a.min, b.min);
+	box.max = glm::max(a.max, b.max);
+	return box;
+}
+
+// Box around the transformed box (Arvo), each axis of the matrix widens it by its absolute value
+AABB transformBox(const AABB &box, const glm::mat4 &model)
+{
+	glm::vec3 center = glm::vec3(model * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+	glm::vec3 halfSize = (box.max - box.min) * 0.5f;
+
+	glm::vec3 extent(0.0f);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		extent += glm::abs(glm::vec3(model[axis])) * halfSize[axis];
+	}
+
+	AABB result;
+	result.min = center - extent;
+	result.max = center + extent;
+	return result;
+}
+
+static float surfaceArea(const AABB &box)
+{
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool containsBox(const AABB &outer, const AABB &inner)
+{
+	return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+}
+
+// -1 outside, 0 crossing, 1 inside
+static int classifyBox(const Frustum &frustum, const AABB &box)
+{
+	int result = 1;
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		glm::vec3 normal(plane);
+
+		// Corners the furthest along and against the normal
+		glm::vec3 positive = glm::mix(box.min, box.max, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+		glm::vec3 negative = glm::mix(box.max, box.min, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+
+		if (glm::dot(normal, positive) + plane.w < 0.0f)
+		{
+			return -1;
+		}
+		if (glm::dot(normal, negative) + plane.w < 0.0f)
+		{
+			result = 0;
+		}
+	}
+	return result;
+}
+
+static bool boxTouchesSphere(const AABB &box, glm::vec3 center, float radius)
+{
+	glm::vec3 closest = glm::clamp(center, box.min, box.max);
+	glm::vec3 offset = closest - center;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+// Slab test, the inverse direction is infinite on the axes the ray does not move along
+static bool boxTouchesRay(const AABB &box, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance)
+{
+	glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	glm::vec3 t1 = (box.max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit;
+}
+
+int SceneBVH::allocateNode()
+{
+	int node;
+	if (freeList != -1)
+	{
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else
+	{
+		node = nodes.size();
+		nodes.push_back(BVHNode());
+	}
+
+	BVHNode &created = nodes[node];
+	created.object = NULL;
+	created.bounds = NULL;
+	created.parent = -1;
+	created.left = -1;
+	created.right = -1;
+	created.height = 0;
+	for (int pass = 0; pass <= passOpaque; pass++)
+	{
+		created.visibleFrame[pass] = 0;
+	}
+	return node;
+}
+
+void SceneBVH::freeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+// The leaf goes next to the node that makes the tree grow the least (surface area heuristic)
+void SceneBVH::insertLeaf(int leaf)
+{
+	if (root == -1)
+	{
+		root = leaf;
+		nodes[root].parent = -1;
+		return;
+	}
+
+	AABB leafBox = nodes[leaf].box;
+	int index = root;
+	while (!nodes[index].isLeaf())
+	{
+		int left = nodes[index].left;
+		int right = nodes[index].right;
+
+		float area = surfaceArea(nodes[index].box);
+		float combinedArea = surfaceArea(mergeBoxes(nodes[index].box, leafBox));
+
+		// Making a new parent here, or pushing the leaf down one of the children
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float costLeft = surfaceArea(mergeBoxes(leafBox, nodes[left].box)) + inheritanceCost;
+		if (!nodes[left].isLeaf())
+		{
+			costLeft -= surfaceArea(nodes[left].box);
+		}
+		float costRight = surfaceArea(mergeBoxes(leafBox, nodes[right].box)) + inheritanceCost;
+		if (!nodes[right].isLeaf())
+		{
+			costRight -= surfaceArea(nodes[right].box);
+		}
+
+		if (cost < costLeft && cost < costRight)
+		{
+			break;
+		}
+		index = (costLeft < costRight) ? left : right;
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = mergeBoxes(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+
+	if (oldParent != -1)
+	{
+		if (nodes[oldParent].left == sibling)
+		{
+			nodes[oldParent].left = newParent;
+		}
+		else
+		{
+			nodes[oldParent].right = newParent;
+		}
+	}
+	else
+	{
+		root = newParent;
+	}
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	// Fix the heights and boxes on the way up
+	index = nodes[leaf].parent;
+	while (index != -1)
+	{
+		index = balance(index);
+
+		int left = nodes[index].left;
+		int right = nodes[index].right;
+		nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+		nodes[index].box = mergeBoxes(nodes[left].box, nodes[right].box);
+
+		index = nodes[index].parent;
+	}
+}
+
+// The sibling takes the place of the parent
+void SceneBVH::removeLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+	if (grandParent != -1)
+	{
+		if (nodes[grandParent].left == parent)
+		{
+			nodes[grandParent].left = sibling;
+		}
+		else
+		{
+			nodes[grandParent].right = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		int index = grandParent;
+		while (index != -1)
+		{
+			index = balance(index);
+
+			int left = nodes[index].left;
+			int right = nodes[index].right;
+			nodes[index].box = mergeBoxes(nodes[left].box, nodes[right].box);
+			nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+
+			index = nodes[index].parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = -1;
+		freeNode(parent);
+	}
+}
+
+// Rotates the higher child up when the two sides differ by more than one level, gives back the node now at this place
+int SceneBVH::balance(int a)
+{
+	if (nodes[a].isLeaf() || nodes[a].height < 2)
+	{
+		return a;
+	}
+
+	int b = nodes[a].left;
+	int c = nodes[a].right;
+	int difference = nodes[c].height - nodes[b].height;
+
+	// The child going up, its children, and the side of "a" it was on
+	int up, low;
+	bool upIsRight;
+	if (difference > 1)
+	{
+		up = c;
+		low = b;
+		upIsRight = true;
+	}
+	else if (difference < -1)
+	{
+		up = b;
+		low = c;
+		upIsRight = false;
+	}
+	else
+	{
+		return a;
+	}
+
+	int f = nodes[up].left;
+	int g = nodes[up].right;
+
+	// "up" replaces "a" under its parent, "a" becomes its left child
+	nodes[up].left = a;
+	nodes[up].parent = nodes[a].parent;
+	nodes[a].parent = up;
+
+	if (nodes[up].parent != -1)
+	{
+		int parent = nodes[up].parent;
+		if (nodes[parent].left == a)
+		{
+			nodes[parent].left = up;
+		}
+		else
+		{
+			nodes[parent].right = up;
+		}
+	}
+	else
+	{
+		root = up;
+	}
+
+	// The higher grandchild stays with "up", the other one goes to "a" in place of "up"
+	int kept = (nodes[f].height > nodes[g].height) ? f : g;
+	int moved = (kept == f) ? g : f;
+	nodes[up].right = kept;
+	if (upIsRight)
+	{
+		nodes[a].right = moved;
+	}
+	else
+	{
+		nodes[a].left = moved;
+	}
+	nodes[moved].parent = a;
+
+	nodes[a].box = mergeBoxes(nodes[low].box, nodes[moved].box);
+	nodes[a].height = 1 + std::max(nodes[low].height, nodes[moved].height);
+	nodes[up].box = mergeBoxes(nodes[a].box, nodes[kept].box);
+	nodes[up].height = 1 + std::max(nodes[a].height, nodes[kept].height);
+
+	return up;
+}
+
+int SceneBVH::createProxy(void *object, BoundsFunction bounds)
+{
+	int proxy = allocateNode();
+	nodes[proxy].object = object;
+	nodes[proxy].bounds = bounds;
+
+	AABB box;
+	bounds(object, box);
+	glm::vec3 enlarge = (box.max - box.min) * margin;
+	nodes[proxy].box.min = box.min - enlarge;
+	nodes[proxy].box.max = box.max + enlarge;
+
+	insertLeaf(proxy);
+	proxies.push_back(proxy);
+	return proxy;
+}
+
+void SceneBVH::destroyProxy(int proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	proxies.erase(std::find(proxies.begin(), proxies.end(), proxy));
+}
+
+// Nothing changes while the box stays in the enlarged one
+bool SceneBVH::moveProxy(int proxy, const AABB &box)
+{
+	if (containsBox(nodes[proxy].box, box))
+	{
+		return false;
+	}
+
+	removeLeaf(proxy);
+
+	glm::vec3 enlarge = (box.max - box.min) * margin;
+	nodes[proxy].box.min = box.min - enlarge;
+	nodes[proxy].box.max = box.max + enlarge;
+
+	insertLeaf(proxy);
+	return true;
+}
+
+// Once per frame, after the objects moved and before culling
+void SceneBVH::refit()
+{
+	for (size_t i = 0; i < proxies.size(); i++)
+	{
+		BVHNode &node = nodes[proxies[i]];
+
+		AABB box;
+		node.bounds(node.object, box);
+		moveProxy(proxies[i], box);
+	}
+}
+
+void SceneBVH::cleanup()
+{
+	nodes.clear();
+	proxies.clear();
+	root = -1;
+	freeList = -1;
+}
+
+void SceneBVH::beginFrame()
+{
+	frame++;
+}
+
+// Subtrees fully inside the frustum are stamped without testing the rest of their boxes
+void SceneBVH::cull(RenderPass pass, const Frustum &frustum)
+{
+	if (root == -1)
+	{
+		return;
+	}
+
+	std::vector<std::pair<int, bool> > stack;
+	stack.push_back(std::make_pair(root, false));
+	while (!stack.empty())
+	{
+		int index = stack.back().first;
+		bool inside = stack.back().second;
+		stack.pop_back();
+
+		const BVHNode &node = nodes[index];
+		if (!inside)
+		{
+			int side = classifyBox(frustum, node.box);
+			if (side < 0)
+			{
+				continue;
+			}
+			inside = (side > 0);
+		}
+
+		if (node.isLeaf())
+		{
+			nodes[index].visibleFrame[pass] = frame;
+		}
+		else
+		{
+			stack.push_back(std::make_pair(node.left, inside));
+			stack.push_back(std::make_pair(node.right, inside));
+		}
+	}
+}
+
+bool SceneBVH::isVisible(int proxy, RenderPass pass) const
+{
+	return nodes[proxy].visibleFrame[pass] == frame;
+}
+
+void SceneBVH::queryFrustum(const Frustum &frustum, std::vector<void *> &objects) const
+{
+	std::vector<int> stack;
+	if (root != -1)
+	{
+		stack.push_back(root);
+	}
+	while (!stack.empty())
+	{
+		const BVHNode &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (classifyBox(frustum, node.box) < 0)
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			objects.push_back(node.object);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void SceneBVH::querySphere(glm::vec3 center, float radius, std::vector<void *> &objects) const
+{
+	std::vector<int> stack;
+	if (root != -1)
+	{
+		stack.push_back(root);
+	}
+	while (!stack.empty())
+	{
+		const BVHNode &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!boxTouchesSphere(node.box, center, radius))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			objects.push_back(node.object);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void SceneBVH::queryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, std::vector<void *> &objects) const
+{
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	std::vector<int> stack;
+	if (root != -1)
+	{
+		stack.push_back(root);
+	}
+	while (!stack.empty())
+	{
+		const BVHNode &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!boxTouchesRay(node.box, origin, inverseDirection, maxDistance))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			objects.push_back(node.object);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
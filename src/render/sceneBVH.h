@@ -0,0 +1,91 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "frustum.h"
+#include "renderQueue.h"
+
+#ifndef SCENEBVH_H
+#define SCENEBVH_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Dynamic bounding volume hierarchy over the scene objects.   //
+//  Every object is a leaf holding a box slightly larger than its   //
+//  own, so small moves do not touch the tree, and the leaf is only //
+//  reinserted once it leaves it. Inner nodes are kept balanced by  //
+//  rotations. Objects give their current box through a callback,   //
+//  refit asks all of them once per frame.                          //
+//																	//
+//      createProxy / destroyProxy : Adds or removes an object.     //
+//      moveProxy : New box for an object, true if it was reinserted//
+//      refit : Calls every bounds callback and moves the proxies.  //
+//      beginFrame / cull / isVisible : cull stamps the proxies     //
+//          touching the frustum of a pass, isVisible tells if the  //
+//          proxy was stamped for that pass this frame.             //
+//      queryFrustum / querySphere / queryRay : Objects whose box   //
+//          touches the volume or the ray, no particular order.     //
+//																	//
+//------------------------------------------------------------------//
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+AABB mergeBoxes(const AABB &a, const AABB &b);
+AABB transformBox(const AABB &box, const glm::mat4 &model);
+
+// Gives the current world box of an object
+typedef void (*BoundsFunction)(void *object, AABB &box);
+
+struct BVHNode {
+    AABB box;                           // Enlarged for leaves
+    void *object;
+    BoundsFunction bounds;
+    int parent;                         // Next free node when unused
+    int left;                           // -1 for leaves
+    int right;
+    int height;                         // 0 for leaves, -1 when unused
+    unsigned long visibleFrame[passOpaque + 1];
+
+    bool isLeaf() const { return left == -1; }
+};
+
+struct SceneBVH {
+
+    int createProxy(void *object, BoundsFunction bounds);
+    void destroyProxy(int proxy);
+    bool moveProxy(int proxy, const AABB &box);
+    void refit();
+    void cleanup();
+
+    // Visibility
+    void beginFrame();
+    void cull(RenderPass pass, const Frustum &frustum);
+    bool isVisible(int proxy, RenderPass pass) const;
+
+    // Queries
+    void queryFrustum(const Frustum &frustum, std::vector<void *> &objects) const;
+    void querySphere(glm::vec3 center, float radius, std::vector<void *> &objects) const;
+    void queryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, std::vector<void *> &objects) const;
+
+    // Tree
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+
+    std::vector<BVHNode> nodes;
+    std::vector<int> proxies;           // Leaves, for refit
+    int root = -1;
+    int freeList = -1;
+    unsigned long frame = 1;
+
+    // Part of the box size added on each side of a leaf
+    float margin = 0.1f;
+};
+
+#endif //SCENEBVH_H
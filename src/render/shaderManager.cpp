@@ -0,0 +1,639 @@
+#include "shaderManager.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "glExtensions.h"
+
+struct ProgramEntry
+{
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string defines;
+	GLuint id = 0;
+	bool built = false;
+};
+
+struct ProgramBinary
+{
+	GLenum format = 0;
+	std::vector<char> data;
+};
+
+// Cache file layout : magic, version, count then (key, format, length, bytes) per program
+static const char shaderCacheMagic[4] = {'S', 'H', 'D', 'C'};
+static const uint32_t shaderCacheVersion = 1;
+
+static std::map<std::string, ProgramEntry> programs;
+static std::vector<std::string> queuedPrograms;
+
+// Object variants by feature bits
+static std::map<GLuint, GLuint> objPrograms;
+static std::map<GLuint, ObjUniforms> objUniforms;
+
+// Link time reflection, units and binding points are shared by name across programs
+static std::map<GLuint, ProgramReflection> reflections;
+static std::map<std::string, GLint> samplerUnits;
+static std::map<std::string, GLuint> blockBindings;
+
+static std::map<uint64_t, ProgramBinary> binaryCache;
+static bool binaryCacheLoaded = false;
+static bool binaryCacheDirty = false;
+
+static std::string programKey(const char *vertexPath, const char *fragmentPath, const std::string &defines)
+{
+	return std::string(vertexPath) + "|" + fragmentPath + "|" + defines;
+}
+
+// The defines go right after the #version line, which must stay first
+static std::string injectDefines(const std::string &source, const std::string &defines)
+{
+	if (defines.empty())
+	{
+		return source;
+	}
+
+	size_t lineEnd = 0;
+	if (source.compare(0, 8, "#version") == 0)
+	{
+		lineEnd = source.find('\n');
+		lineEnd = (lineEnd == std::string::npos) ? source.size() : lineEnd + 1;
+	}
+
+	std::string injected = source.substr(0, lineEnd);
+	if (!injected.empty() && injected[injected.size() - 1] != '\n')
+	{
+		injected += '\n';
+	}
+	return injected + defines + "#line 2\n" + source.substr(lineEnd);
+}
+
+static std::string objDefines(GLuint features)
+{
+	static const char *names[] = {"SHADOWS", "INSTANCING", "SKINNING", "TEXTURE", "LIGHTING", "DEPTH", "BATCHED"};
+
+	std::string defines;
+	for (int i = 0; i < 7; i++)
+	{
+		if (features & (1u << i))
+		{
+			defines += std::string("#define ") + names[i] + "\n";
+		}
+	}
+	return defines;
+}
+
+static bool readSource(const std::string &path, std::string &source)
+{
+	std::ifstream stream(path.c_str(), std::ios::in);
+	if (!stream.is_open())
+	{
+		std::cerr << "Shader not found " << path << std::endl;
+		return false;
+	}
+
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	source = sstr.str();
+	return true;
+}
+
+// FNV-1a, only used to tell sources apart
+static uint64_t hashBytes(const std::string &bytes, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < bytes.size(); i++)
+	{
+		hash ^= static_cast<unsigned char>(bytes[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static std::string glString(GLenum name)
+{
+	const GLubyte *value = glGetString(name);
+	return value != NULL ? std::string(reinterpret_cast<const char *>(value)) : std::string();
+}
+
+// Binaries are only valid for the driver that made them
+static uint64_t binaryKey(const std::string &vertexSource, const std::string &fragmentSource)
+{
+	static const std::string driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+	uint64_t hash = hashBytes(driver);
+	hash = hashBytes(vertexSource, hashBytes("|", hash));
+	return hashBytes(fragmentSource, hashBytes("|", hash));
+}
+
+static void loadBinaryCache()
+{
+	binaryCacheLoaded = true;
+
+	std::ifstream file(shaderCachePath, std::ios::binary);
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	char magic[4];
+	uint32_t version = 0, count = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char *>(&version), sizeof(version));
+	file.read(reinterpret_cast<char *>(&count), sizeof(count));
+	if (!file || std::string(magic, 4) != std::string(shaderCacheMagic, 4) || version != shaderCacheVersion)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint64_t key = 0;
+		uint32_t format = 0, length = 0;
+		file.read(reinterpret_cast<char *>(&key), sizeof(key));
+		file.read(reinterpret_cast<char *>(&format), sizeof(format));
+		file.read(reinterpret_cast<char *>(&length), sizeof(length));
+		if (!file)
+		{
+			break;
+		}
+
+		ProgramBinary binary;
+		binary.format = format;
+		binary.data.resize(length);
+		file.read(binary.data.data(), length);
+		if (!file)
+		{
+			break;
+		}
+		binaryCache[key] = binary;
+	}
+}
+
+static void saveBinaryCache()
+{
+	std::ofstream file(shaderCachePath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Could not write the shader cache " << shaderCachePath << std::endl;
+		return;
+	}
+
+	uint32_t count = static_cast<uint32_t>(binaryCache.size());
+	file.write(shaderCacheMagic, sizeof(shaderCacheMagic));
+	file.write(reinterpret_cast<const char *>(&shaderCacheVersion), sizeof(shaderCacheVersion));
+	file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+	for (std::map<uint64_t, ProgramBinary>::const_iterator it = binaryCache.begin(); it != binaryCache.end(); ++it)
+	{
+		uint32_t format = it->second.format;
+		uint32_t length = static_cast<uint32_t>(it->second.data.size());
+		file.write(reinterpret_cast<const char *>(&it->first), sizeof(it->first));
+		file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+		file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+		file.write(it->second.data.data(), length);
+	}
+	binaryCacheDirty = false;
+}
+
+static bool loadProgramBinary(GLuint program, uint64_t key)
+{
+	std::map<uint64_t, ProgramBinary>::const_iterator it = binaryCache.find(key);
+	if (it == binaryCache.end())
+	{
+		return false;
+	}
+
+	ext_glProgramBinary(program, it->second.format, it->second.data.data(), static_cast<GLsizei>(it->second.data.size()));
+
+	// A driver update can refuse an old binary, the program is then built from source
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		binaryCache.erase(key);
+		binaryCacheDirty = true;
+		return false;
+	}
+	return true;
+}
+
+static void storeProgramBinary(GLuint program, uint64_t key)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	ProgramBinary &binary = binaryCache[key];
+	binary.data.resize(length);
+	ext_glGetProgramBinary(program, length, NULL, &binary.format, binary.data.data());
+	binaryCacheDirty = true;
+}
+
+static void printShaderLog(GLuint shader, const std::string &path)
+{
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	if (length > 1)
+	{
+		std::vector<char> message(length + 1);
+		glGetShaderInfoLog(shader, length, NULL, &message[0]);
+		std::cerr << path << " :\n" << &message[0] << std::endl;
+	}
+}
+
+static void printProgramLog(GLuint program, const std::string &name)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	if (length > 1)
+	{
+		std::vector<char> message(length + 1);
+		glGetProgramInfoLog(program, length, NULL, &message[0]);
+		std::cerr << name << " :\n" << &message[0] << std::endl;
+	}
+}
+
+static bool isSamplerType(GLenum type)
+{
+	switch (type)
+	{
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_CUBE_SHADOW:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_SAMPLER_BUFFER:
+	case GL_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Reads the active uniforms and blocks once and sets their units and binding points
+static void reflectProgram(GLuint program)
+{
+	ProgramReflection &reflection = reflections[program];
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+
+	glUseProgram(program);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, i, maxLength, NULL, &size, &type, &name[0]);
+
+		// Block members have no location
+		GLint location = glGetUniformLocation(program, &name[0]);
+		if (location < 0)
+		{
+			continue;
+		}
+
+		// Arrays are listed as "name[0]"
+		std::string uniformName(&name[0]);
+		size_t bracket = uniformName.find('[');
+		if (bracket != std::string::npos)
+		{
+			uniformName.resize(bracket);
+		}
+		reflection.uniforms[uniformName] = location;
+
+		if (isSamplerType(type))
+		{
+			GLint unit = getSamplerUnit(uniformName.c_str());
+			glUniform1i(location, unit);
+			reflection.samplerUnits[uniformName] = unit;
+		}
+	}
+	glUseProgram(0);
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+	name.resize(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveUniformBlockName(program, i, maxLength, NULL, &name[0]);
+
+		GLuint binding = getBlockBinding(&name[0]);
+		glUniformBlockBinding(program, i, binding);
+		reflection.blockBindings[&name[0]] = binding;
+	}
+}
+
+GLint ProgramReflection::uniform(const char *name) const
+{
+	std::map<std::string, GLint>::const_iterator it = uniforms.find(name);
+	return it != uniforms.end() ? it->second : -1;
+}
+
+GLint ProgramReflection::samplerUnit(const char *name) const
+{
+	std::map<std::string, GLint>::const_iterator it = samplerUnits.find(name);
+	return it != samplerUnits.end() ? it->second : -1;
+}
+
+const ProgramReflection &getProgramReflection(GLuint program)
+{
+	// Failed programs (0) get an empty table
+	return reflections[program];
+}
+
+GLint getSamplerUnit(const char *samplerName)
+{
+	std::map<std::string, GLint>::iterator it = samplerUnits.find(samplerName);
+	if (it != samplerUnits.end())
+	{
+		return it->second;
+	}
+
+	GLint unit = static_cast<GLint>(samplerUnits.size());
+	samplerUnits[samplerName] = unit;
+	return unit;
+}
+
+GLuint getBlockBinding(const char *blockName)
+{
+	std::map<std::string, GLuint>::iterator it = blockBindings.find(blockName);
+	if (it != blockBindings.end())
+	{
+		return it->second;
+	}
+
+	GLuint binding = static_cast<GLuint>(blockBindings.size());
+	blockBindings[blockName] = binding;
+	return binding;
+}
+
+void queueProgram(const char *vertexPath, const char *fragmentPath, const std::string &defines)
+{
+	std::string key = programKey(vertexPath, fragmentPath, defines);
+	if (programs.count(key) > 0)
+	{
+		return;
+	}
+
+	ProgramEntry &entry = programs[key];
+	entry.vertexPath = vertexPath;
+	entry.fragmentPath = fragmentPath;
+	entry.defines = defines;
+	queuedPrograms.push_back(key);
+}
+
+void buildPrograms()
+{
+	if (queuedPrograms.empty())
+	{
+		return;
+	}
+
+	bool useBinaries = hasProgramBinary();
+	if (useBinaries && !binaryCacheLoaded)
+	{
+		loadBinaryCache();
+	}
+	if (ext_glMaxShaderCompilerThreads != NULL)
+	{
+		ext_glMaxShaderCompilerThreads(0xFFFFFFFF);
+	}
+
+	// Files are read once, stages are keyed by path and defines
+	std::map<std::string, std::string> files, sources;
+	std::vector<ProgramEntry *> toLink;
+	std::vector<uint64_t> toLinkKeys;
+
+	for (size_t i = 0; i < queuedPrograms.size(); i++)
+	{
+		ProgramEntry &entry = programs[queuedPrograms[i]];
+		entry.built = true;
+
+		const std::string *paths[2] = {&entry.vertexPath, &entry.fragmentPath};
+		bool found = true;
+		for (int s = 0; s < 2; s++)
+		{
+			if (files.count(*paths[s]) == 0 && !readSource(*paths[s], files[*paths[s]]))
+			{
+				found = false;
+			}
+			sources[*paths[s] + "|" + entry.defines] = injectDefines(files[*paths[s]], entry.defines);
+		}
+		if (!found)
+		{
+			continue;
+		}
+
+		uint64_t key = binaryKey(sources[entry.vertexPath + "|" + entry.defines], sources[entry.fragmentPath + "|" + entry.defines]);
+		entry.id = glCreateProgram();
+		if (useBinaries && loadProgramBinary(entry.id, key))
+		{
+			reflectProgram(entry.id);
+			continue;
+		}
+
+		toLink.push_back(&entry);
+		toLinkKeys.push_back(key);
+	}
+	queuedPrograms.clear();
+
+	// Compile every stage first, nothing below waits on the driver until the statuses are read
+	std::map<std::string, GLuint> vertexStages, fragmentStages;
+	for (size_t i = 0; i < toLink.size(); i++)
+	{
+		std::string stageKeys[2] = {toLink[i]->vertexPath + "|" + toLink[i]->defines, toLink[i]->fragmentPath + "|" + toLink[i]->defines};
+		std::map<std::string, GLuint> *stages[2] = {&vertexStages, &fragmentStages};
+		GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+
+		for (int s = 0; s < 2; s++)
+		{
+			if (stages[s]->count(stageKeys[s]) > 0)
+			{
+				continue;
+			}
+
+			GLuint shader = glCreateShader(types[s]);
+			const char *source = sources[stageKeys[s]].c_str();
+			glShaderSource(shader, 1, &source, NULL);
+			glCompileShader(shader);
+			(*stages[s])[stageKeys[s]] = shader;
+		}
+	}
+
+	for (size_t i = 0; i < toLink.size(); i++)
+	{
+		GLuint program = toLink[i]->id;
+		if (useBinaries)
+		{
+			ext_glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glAttachShader(program, vertexStages[toLink[i]->vertexPath + "|" + toLink[i]->defines]);
+		glAttachShader(program, fragmentStages[toLink[i]->fragmentPath + "|" + toLink[i]->defines]);
+		glLinkProgram(program);
+	}
+
+	// Now read the results
+	std::map<std::string, GLuint> *stageMaps[2] = {&vertexStages, &fragmentStages};
+	for (int s = 0; s < 2; s++)
+	{
+		for (std::map<std::string, GLuint>::iterator it = stageMaps[s]->begin(); it != stageMaps[s]->end(); ++it)
+		{
+			GLint compiled = GL_FALSE;
+			glGetShaderiv(it->second, GL_COMPILE_STATUS, &compiled);
+			if (compiled != GL_TRUE)
+			{
+				std::cerr << "Failed to compile " << it->first << std::endl;
+			}
+			printShaderLog(it->second, it->first);
+		}
+	}
+
+	for (size_t i = 0; i < toLink.size(); i++)
+	{
+		ProgramEntry &entry = *toLink[i];
+		std::string name = entry.vertexPath + " + " + entry.fragmentPath;
+		if (!entry.defines.empty())
+		{
+			name += " (" + entry.defines + ")";
+		}
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(entry.id, GL_LINK_STATUS, &linked);
+		printProgramLog(entry.id, name);
+
+		glDetachShader(entry.id, vertexStages[entry.vertexPath + "|" + entry.defines]);
+		glDetachShader(entry.id, fragmentStages[entry.fragmentPath + "|" + entry.defines]);
+
+		if (linked != GL_TRUE)
+		{
+			std::cerr << "Failed to link " << name << std::endl;
+			glDeleteProgram(entry.id);
+			entry.id = 0;
+			continue;
+		}
+
+		if (useBinaries)
+		{
+			storeProgramBinary(entry.id, toLinkKeys[i]);
+		}
+		reflectProgram(entry.id);
+	}
+
+	// The programs keep what they need, the stages can go
+	for (int s = 0; s < 2; s++)
+	{
+		for (std::map<std::string, GLuint>::iterator it = stageMaps[s]->begin(); it != stageMaps[s]->end(); ++it)
+		{
+			glDeleteShader(it->second);
+		}
+	}
+
+	if (binaryCacheDirty)
+	{
+		saveBinaryCache();
+	}
+}
+
+GLuint getProgram(const char *vertexPath, const char *fragmentPath, const std::string &defines)
+{
+	std::string key = programKey(vertexPath, fragmentPath, defines);
+
+	std::map<std::string, ProgramEntry>::iterator it = programs.find(key);
+	if (it == programs.end() || !it->second.built)
+	{
+		queueProgram(vertexPath, fragmentPath, defines);
+		buildPrograms();
+		it = programs.find(key);
+	}
+
+	return it->second.id;
+}
+
+static GLuint objVariant(GLuint features)
+{
+	// The depth variant only cares about what moves the vertices
+	if (features & obj_dpth)
+	{
+		features &= obj_dpth | obj_i | obj_a | obj_b;
+	}
+	return features;
+}
+
+void queueObjProgram(GLuint features)
+{
+	features = objVariant(features);
+	if (objPrograms.count(features) == 0)
+	{
+		queueProgram(objVertexPath, objFragmentPath, objDefines(features));
+	}
+}
+
+GLuint getObjProgram(GLuint features)
+{
+	features = objVariant(features);
+
+	std::map<GLuint, GLuint>::iterator it = objPrograms.find(features);
+	if (it != objPrograms.end())
+	{
+		return it->second;
+	}
+
+	GLuint program = getProgram(objVertexPath, objFragmentPath, objDefines(features));
+	objPrograms[features] = program;
+	return program;
+}
+
+const ObjUniforms &getObjUniforms(GLuint features)
+{
+	features = objVariant(features);
+
+	std::map<GLuint, ObjUniforms>::iterator it = objUniforms.find(features);
+	if (it != objUniforms.end())
+	{
+		return it->second;
+	}
+
+	const ProgramReflection &reflection = getProgramReflection(getObjProgram(features));
+
+	ObjUniforms &uniforms = objUniforms[features];
+	uniforms.mvp = reflection.uniform("MVP");
+	uniforms.lvp = reflection.uniform("LVP");
+	uniforms.lightPosition = reflection.uniform("lightPosition");
+	uniforms.lightIntensity = reflection.uniform("lightIntensity");
+	uniforms.baseColorFactor = reflection.uniform("baseColorFactor");
+	uniforms.metallicFactor = reflection.uniform("metallicFactor");
+	uniforms.roughnessFactor = reflection.uniform("roughnessFactor");
+	uniforms.textureUnit = reflection.samplerUnit("textureSampler");
+	uniforms.depthTextureUnit = reflection.samplerUnit("depthTextureSampler");
+	uniforms.jointMatrices = reflection.blockBindings.count("jointMatrices") > 0;
+	return uniforms;
+}
+
+void releasePrograms()
+{
+	for (std::map<std::string, ProgramEntry>::iterator it = programs.begin(); it != programs.end(); ++it)
+	{
+		glDeleteProgram(it->second.id);
+	}
+	programs.clear();
+	queuedPrograms.clear();
+	objPrograms.clear();
+	objUniforms.clear();
+	reflections.clear();
+}
@@ -0,0 +1,103 @@
+#include <glad/gl.h>
+
+#include <map>
+#include <string>
+
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Shared shader programs, keyed by their vertex and fragment  //
+//  paths. Stages used by several programs are compiled once, and   //
+//  every stage of a batch is compiled before any status is read    //
+//  so the driver can work on them in parallel.                     //
+//  Linked programs are saved with glGetProgramBinary in a cache    //
+//  file, keyed by the sources and the driver, so the next launches //
+//  skip the compilation when nothing changed.                      //
+//																	//
+//      queueProgram : Adds a program to the next batch.            //
+//      buildPrograms : Compiles and links everything queued.       //
+//      getProgram : Returns the program, built now if needed. A    //
+//          failed program is 0.                                    //
+//      releasePrograms : Deletes every program, call at exit.      //
+//																	//
+//  Reflection :                                                    //
+//      Active uniforms, samplers and blocks are read once at link  //
+//  time. A sampler or block name gets the same texture unit or     //
+//  binding point in every program, set on the program right away,  //
+//  so the frame loop only binds textures and buffers.              //
+//      getProgramReflection : Table of a built program.            //
+//      getSamplerUnit / getBlockBinding : Unit or binding point    //
+//          used for a name in all programs.                        //
+//																	//
+//  Object shaders :                                                //
+//      Every gltfObj uses one uber source (obj.vert/obj.frag), a   //
+//  variant is a mask of ObjShaderFeatures turned into #defines, so //
+//  the fragments have no uniform driven branches left.             //
+//      queueObjProgram : Adds the variant to the next batch.       //
+//      getObjProgram : Returns the variant, building everything    //
+//          queued so far on its first use.                         //
+//      getObjUniforms : Typed handles of a variant, -1 for what    //
+//          it does not use.                                        //
+//																	//
+//------------------------------------------------------------------//
+
+// Binary cache, relative to the working directory like the assets
+const char *const shaderCachePath = "shaderCache.bin";
+
+const char *const objVertexPath = "../src/shaders/obj/obj.vert";
+const char *const objFragmentPath = "../src/shaders/obj/obj.frag";
+
+// Feature bits, named after the conventions.md suffixes
+enum ObjShaderFeatures
+{
+    obj_s    = 1 << 0,      // Receives shadows (SHADOWS)
+    obj_i    = 1 << 1,      // Instanced (INSTANCING)
+    obj_a    = 1 << 2,      // Skinned (SKINNING)
+    obj_tex  = 1 << 3,      // Textured, flat color otherwise (TEXTURE)
+    obj_l    = 1 << 4,      // Light simulation, _nl objects go without (LIGHTING)
+    obj_dpth = 1 << 5,      // Depth only, keeps _i, _a and _b (DEPTH)
+    obj_b    = 1 << 6       // Static batch, pre-skinned vertices and per-draw colors (BATCHED)
+};
+
+struct ProgramReflection
+{
+    std::map<std::string, GLint> uniforms;          // Location of every active uniform outside of blocks
+    std::map<std::string, GLint> samplerUnits;      // Texture unit each sampler reads
+    std::map<std::string, GLuint> blockBindings;    // Binding point each uniform block reads
+
+    GLint uniform(const char *name) const;
+    GLint samplerUnit(const char *name) const;
+};
+
+struct ObjUniforms
+{
+    GLint mvp = -1;
+    GLint lvp = -1;
+    GLint lightPosition = -1;
+    GLint lightIntensity = -1;
+    GLint baseColorFactor = -1;
+    GLint metallicFactor = -1;
+    GLint roughnessFactor = -1;
+
+    // Units and binding points, already set in the program
+    GLint textureUnit = -1;
+    GLint depthTextureUnit = -1;
+    bool jointMatrices = false;
+};
+
+void queueProgram(const char *vertexPath, const char *fragmentPath, const std::string &defines = "");
+void buildPrograms();
+GLuint getProgram(const char *vertexPath, const char *fragmentPath, const std::string &defines = "");
+void releasePrograms();
+
+const ProgramReflection &getProgramReflection(GLuint program);
+GLint getSamplerUnit(const char *samplerName);
+GLuint getBlockBinding(const char *blockName);
+
+void queueObjProgram(GLuint features);
+GLuint getObjProgram(GLuint features);
+const ObjUniforms &getObjUniforms(GLuint features);
+
+#endif //SHADERMANAGER_H
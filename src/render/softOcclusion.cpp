@@ -0,0 +1,400 @@
+#include "softOcclusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTOCCLUSION_SSE
+#endif
+
+// Clip space w under which a volume is taken as crossing the eye plane
+static const float minimumW = 1e-5f;
+
+// Vertices are snapped to 1/16 of a pixel, and clipped to four times the screen so the edge functions fit in 32 bits
+static const int subpixelSteps = 1 << softOcclusionSubpixelBits;
+static const float guardBand = 4.0f;
+
+void SoftOcclusion::init(ThreadPool *pool)
+{
+	this -> pool = pool;
+	depth.assign(softOcclusionWidth * softOcclusionHeight, 1.0f);
+	rendered = false;
+}
+
+void SoftOcclusion::cleanup()
+{
+	occluders.clear();
+	models.clear();
+	projected.clear();
+	depth.clear();
+	pool = NULL;
+	rendered = false;
+}
+
+// Free slots are reused
+int SoftOcclusion::addOccluder(const std::vector<glm::vec3> &triangles, void *object, OccluderFunction matrices)
+{
+	size_t occluder = 0;
+	while (occluder < occluders.size() && occluders[occluder].used)
+	{
+		occluder++;
+	}
+	if (occluder == occluders.size())
+	{
+		occluders.push_back(SoftOccluder());
+	}
+
+	SoftOccluder &slot = occluders[occluder];
+	slot.triangles = triangles;
+	slot.object = object;
+	slot.matrices = matrices;
+	slot.used = true;
+	return occluder;
+}
+
+void SoftOcclusion::removeOccluder(int occluder)
+{
+	if (occluder < 0 || occluder >= (int)occluders.size())
+	{
+		return;
+	}
+	occluders[occluder].used = false;
+	std::vector<glm::vec3>().swap(occluders[occluder].triangles);
+}
+
+// Projection on the calling thread, the bands are then filled in parallel, each one only writes its own rows
+void SoftOcclusion::render(const glm::mat4 &viewProjection)
+{
+	this -> viewProjection = viewProjection;
+	projected.clear();
+
+	for (size_t o = 0; o < occluders.size(); o++)
+	{
+		const SoftOccluder &occluder = occluders[o];
+		if (!occluder.used)
+		{
+			continue;
+		}
+
+		models.clear();
+		occluder.matrices(occluder.object, models);
+		for (size_t m = 0; m < models.size(); m++)
+		{
+			glm::mat4 mvp = viewProjection * models[m];
+			for (size_t t = 0; t + 2 < occluder.triangles.size(); t += 3)
+			{
+				glm::vec4 clip[3];
+				for (int v = 0; v < 3; v++)
+				{
+					clip[v] = mvp * glm::vec4(occluder.triangles[t + v], 1.0f);
+				}
+				projectTriangle(clip);
+			}
+		}
+	}
+
+	int bands = softOcclusionHeight / softOcclusionBandHeight;
+	if (pool != NULL)
+	{
+		for (int band = 0; band < bands; band++)
+		{
+			pool->submit([this, band] { rasterizeBand(band); });
+		}
+		pool->wait();
+	}
+	else
+	{
+		for (int band = 0; band < bands; band++)
+		{
+			rasterizeBand(band);
+		}
+	}
+	rendered = true;
+}
+
+// Sutherland-Hodgman against one plane, each new vertex goes from the inside end of its edge so triangles sharing the edge cut it at the same point
+static int clipPolygon(const glm::vec4 *polygon, int count, const glm::vec4 &plane, glm::vec4 *clipped)
+{
+	int kept = 0;
+	for (int v = 0; v < count; v++)
+	{
+		const glm::vec4 &a = polygon[v];
+		const glm::vec4 &b = polygon[(v + 1) % count];
+		float da = glm::dot(plane, a);
+		float db = glm::dot(plane, b);
+
+		if (da >= 0.0f)
+		{
+			clipped[kept++] = a;
+		}
+		if ((da >= 0.0f) != (db >= 0.0f))
+		{
+			clipped[kept++] = (da >= 0.0f) ? a + (b - a) * (da / (da - db)) : b + (a - b) * (db / (db - da));
+		}
+	}
+	return kept;
+}
+
+// Cut by the near plane (z = -w) and the guard band, what is left is made window coordinates snapped to the subpixel grid
+void SoftOcclusion::projectTriangle(const glm::vec4 clip[3])
+{
+	// Each plane adds one vertex at most
+	static const glm::vec4 planes[5] = {
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		glm::vec4(1.0f, 0.0f, 0.0f, guardBand), glm::vec4(-1.0f, 0.0f, 0.0f, guardBand),
+		glm::vec4(0.0f, 1.0f, 0.0f, guardBand), glm::vec4(0.0f, -1.0f, 0.0f, guardBand)
+	};
+	glm::vec4 polygon[2][8];
+	int count = 3;
+	int current = 0;
+	std::copy(clip, clip + 3, polygon[0]);
+	for (int p = 0; p < 5 && count >= 3; p++)
+	{
+		count = clipPolygon(polygon[current], count, planes[p], polygon[1 - current]);
+		current = 1 - current;
+	}
+	if (count < 3)
+	{
+		return;
+	}
+
+	int x[8], y[8];
+	float z[8];
+	for (int v = 0; v < count; v++)
+	{
+		const glm::vec4 &vertex = polygon[current][v];
+		float w = std::max(vertex.w, minimumW);
+		glm::vec3 ndc = glm::vec3(vertex) / w;
+		x[v] = (int)std::lround((ndc.x * 0.5f + 0.5f) * softOcclusionWidth * subpixelSteps);
+		y[v] = (int)std::lround((ndc.y * 0.5f + 0.5f) * softOcclusionHeight * subpixelSteps);
+		z[v] = ndc.z * 0.5f + 0.5f;
+	}
+
+	for (int v = 1; v + 1 < count; v++)
+	{
+		SoftTriangle triangle;
+		int corners[3] = {0, v, v + 1};
+		for (int c = 0; c < 3; c++)
+		{
+			triangle.x[c] = x[corners[c]];
+			triangle.y[c] = y[corners[c]];
+			triangle.z[c] = z[corners[c]];
+		}
+
+		int minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+		int maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+		int minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+		int maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+		float minZ = std::min(triangle.z[0], std::min(triangle.z[1], triangle.z[2]));
+
+		// Out of the screen or past the far plane
+		if (maxX < 0 || minX > softOcclusionWidth * subpixelSteps || maxY < 0 || minY > softOcclusionHeight * subpixelSteps || minZ > 1.0f)
+		{
+			continue;
+		}
+		triangle.minY = std::max(0, minY >> softOcclusionSubpixelBits);
+		triangle.maxY = std::min(softOcclusionHeight - 1, maxY >> softOcclusionSubpixelBits);
+		projected.push_back(triangle);
+	}
+}
+
+// Edge functions are exact integers of the pixel centre, a pixel is covered when all three are positive, or zero on a top or left edge
+// In the guard band they stay under 2^29, the whole row fits in 32 bits
+void SoftOcclusion::rasterizeBand(int band)
+{
+	int bandFirst = band * softOcclusionBandHeight;
+	int bandLast = bandFirst + softOcclusionBandHeight - 1;
+	std::fill(depth.begin() + bandFirst * softOcclusionWidth, depth.begin() + (bandLast + 1) * softOcclusionWidth, 1.0f);
+
+	const int half = subpixelSteps / 2;
+	for (size_t t = 0; t < projected.size(); t++)
+	{
+		const SoftTriangle &triangle = projected[t];
+		if (triangle.maxY < bandFirst || triangle.minY > bandLast)
+		{
+			continue;
+		}
+
+		// Both sides are drawn, the winding is made counter clockwise
+		int first = 1, second = 2;
+		long long area = (long long)(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+			- (long long)(triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+		if (area < 0)
+		{
+			std::swap(first, second);
+			area = -area;
+		}
+		if (area == 0)
+		{
+			continue;
+		}
+		int vx[3] = {triangle.x[0], triangle.x[first], triangle.x[second]};
+		int vy[3] = {triangle.y[0], triangle.y[first], triangle.y[second]};
+		float vz[3] = {triangle.z[0], triangle.z[first], triangle.z[second]};
+
+		// E(x, y) = a * (x - from.x) + b * (y - from.y) for the edges v0v1, v1v2, v2v0, a shared edge gets the opposite one in the other triangle
+		// Off the top and left edges the bias makes zero fail, so exactly one of the two covers the pixels on it
+		int a[3], b[3], bias[3];
+		for (int e = 0; e < 3; e++)
+		{
+			int to = (e + 1) % 3;
+			a[e] = vy[e] - vy[to];
+			b[e] = vx[to] - vx[e];
+			bias[e] = (a[e] > 0 || (a[e] == 0 && b[e] < 0)) ? 0 : -1;
+		}
+
+		// Each edge weighs the vertex in front of it, the plane is in pixels from the first vertex
+		float pixelArea = (float)area / subpixelSteps;
+		float zx = (a[1] * vz[0] + a[2] * vz[1] + a[0] * vz[2]) / pixelArea;
+		float zy = (b[1] * vz[0] + b[2] * vz[1] + b[0] * vz[2]) / pixelArea;
+		float x0 = (float)vx[0] / subpixelSteps;
+		float y0 = (float)vy[0] / subpixelSteps;
+
+		int minX = std::min(vx[0], std::min(vx[1], vx[2]));
+		int maxX = std::max(vx[0], std::max(vx[1], vx[2]));
+		int firstX = std::max(0, minX >> softOcclusionSubpixelBits) & ~3;
+		int lastX = std::min(softOcclusionWidth - 1, maxX >> softOcclusionSubpixelBits);
+		int firstY = std::max(bandFirst, triangle.minY);
+		int lastY = std::min(bandLast, triangle.maxY);
+
+		int step[3];
+		for (int e = 0; e < 3; e++)
+		{
+			step[e] = a[e] * subpixelSteps;
+		}
+
+		for (int y = firstY; y <= lastY; y++)
+		{
+			float py = y + 0.5f;
+			float rowZ = vz[0] + zy * (py - y0) - zx * x0;
+			float *row = &depth[y * softOcclusionWidth];
+			int rowE[3];
+			for (int e = 0; e < 3; e++)
+			{
+				rowE[e] = a[e] * ((firstX << softOcclusionSubpixelBits) + half - vx[e]) + b[e] * ((y << softOcclusionSubpixelBits) + half - vy[e]) + bias[e];
+			}
+			int x = firstX;
+
+#ifdef SOFTOCCLUSION_SSE
+			// The width is a multiple of four and the first pixel is aligned on four, no block leaves the row
+			if (simd)
+			{
+				__m128i e0 = _mm_add_epi32(_mm_set1_epi32(rowE[0]), _mm_set_epi32(3 * step[0], 2 * step[0], step[0], 0));
+				__m128i e1 = _mm_add_epi32(_mm_set1_epi32(rowE[1]), _mm_set_epi32(3 * step[1], 2 * step[1], step[1], 0));
+				__m128i e2 = _mm_add_epi32(_mm_set1_epi32(rowE[2]), _mm_set_epi32(3 * step[2], 2 * step[2], step[2], 0));
+				__m128i step0 = _mm_set1_epi32(4 * step[0]), step1 = _mm_set1_epi32(4 * step[1]), step2 = _mm_set1_epi32(4 * step[2]);
+				__m128i minusOne = _mm_set1_epi32(-1);
+				__m128 aZ = _mm_set1_ps(zx), bZ = _mm_set1_ps(rowZ);
+				for (; x <= lastX; x += 4)
+				{
+					// No sign bit in any of the three
+					__m128 inside = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(e0, _mm_or_si128(e1, e2)), minusOne));
+					e0 = _mm_add_epi32(e0, step0);
+					e1 = _mm_add_epi32(e1, step1);
+					e2 = _mm_add_epi32(e2, step2);
+					if (_mm_movemask_ps(inside) == 0)
+					{
+						continue;
+					}
+
+					__m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+					__m128 old = _mm_loadu_ps(row + x);
+					__m128 closest = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(aZ, px), bZ));
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, old)));
+				}
+			}
+#endif
+
+			// Same values as the SSE loop, the buffers are identical
+			int e0 = rowE[0] + (x - firstX) * step[0];
+			int e1 = rowE[1] + (x - firstX) * step[1];
+			int e2 = rowE[2] + (x - firstX) * step[2];
+			for (; x <= lastX; x++)
+			{
+				if ((e0 | e1 | e2) >= 0)
+				{
+					float px = x + 0.5f;
+					row[x] = std::min(row[x], zx * px + rowZ);
+				}
+				e0 += step[0];
+				e1 += step[1];
+				e2 += step[2];
+			}
+		}
+	}
+}
+
+// Screen rectangle of the eight corners and the depth of the closest one
+bool SoftOcclusion::isBoxOccluded(glm::vec3 min, glm::vec3 max) const
+{
+	if (!rendered)
+	{
+		return false;
+	}
+
+	glm::vec2 rectMin(softOcclusionWidth, softOcclusionHeight);
+	glm::vec2 rectMax(0.0f);
+	float nearestDepth = 1.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+		if (clip.w < minimumW || clip.z < -clip.w)
+		{
+			return false;
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 window((ndc.x * 0.5f + 0.5f) * softOcclusionWidth, (ndc.y * 0.5f + 0.5f) * softOcclusionHeight);
+		rectMin = glm::min(rectMin, window);
+		rectMax = glm::max(rectMax, window);
+		nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+	return isRectOccluded(rectMin, rectMax, nearestDepth);
+}
+
+bool SoftOcclusion::isSphereOccluded(glm::vec3 center, float radius) const
+{
+	return isBoxOccluded(center - glm::vec3(radius), center + glm::vec3(radius));
+}
+
+// Every pixel the rectangle touches must hold something closer, only the part on screen is looked at
+bool SoftOcclusion::isRectOccluded(glm::vec2 min, glm::vec2 max, float nearestDepth) const
+{
+	if (max.x < 0.0f || min.x >= softOcclusionWidth || max.y < 0.0f || min.y >= softOcclusionHeight)
+	{
+		return false;
+	}
+
+	int firstX = std::max(0, (int)std::floor(min.x));
+	int lastX = std::min(softOcclusionWidth - 1, (int)std::floor(max.x));
+	int firstY = std::max(0, (int)std::floor(min.y));
+	int lastY = std::min(softOcclusionHeight - 1, (int)std::floor(max.y));
+
+	for (int y = firstY; y <= lastY; y++)
+	{
+		const float *row = &depth[y * softOcclusionWidth];
+		int x = firstX;
+
+#ifdef SOFTOCCLUSION_SSE
+		__m128 nearest = _mm_set1_ps(nearestDepth);
+		for (; x + 4 <= lastX + 1; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)) != 0)
+			{
+				return false;
+			}
+		}
+#endif
+
+		for (; x <= lastX; x++)
+		{
+			if (row[x] >= nearestDepth)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
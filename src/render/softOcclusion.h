@@ -0,0 +1,93 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "threadPool.h"
+
+#ifndef SOFTOCCLUSION_H
+#define SOFTOCCLUSION_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Occlusion culling on the CPU, the alternative to the        //
+//  hardware queries that needs no GL context at all. A few big     //
+//  occluders (the dome shell, the door) are rasterized in a small  //
+//  depth buffer, then the boxes and spheres of the objects and     //
+//  their instances are tested against it before being queued.      //
+//  The buffer is cut in horizontal bands, each one rasterized by   //
+//  its own ThreadPool task, four pixels at a time with SSE2 (a     //
+//  scalar loop does the rest and everything without SSE2).         //
+//  Vertices are snapped to a subpixel grid and the edges evaluated //
+//  in integers with a top-left rule, triangles sharing an edge     //
+//  leave no gap. Triangles are clipped by the near plane and a     //
+//  guard band, both sides are drawn. Depths are the window ones,   //
+//  0 near and 1 far.                                               //
+//																	//
+//      init / cleanup : Buffer, and the pool the bands run on      //
+//          (NULL rasterizes them one after the other).             //
+//      addOccluder / removeOccluder : Model space triangles (three //
+//          vertices each), the callback gives their matrices of    //
+//          the frame, one copy is drawn per matrix.                //
+//      render : Clears the buffer and rasterizes every occluder    //
+//          seen through the view projection, call once the         //
+//          occluders moved and before anything is tested.          //
+//      isBoxOccluded / isSphereOccluded : True if the screen area  //
+//          of the volume is fully behind the occluders. Volumes    //
+//          crossing the near plane are never occluded.             //
+//																	//
+//------------------------------------------------------------------//
+
+// Size of the depth buffer, the width must stay a multiple of four
+const int softOcclusionWidth = 256;
+const int softOcclusionHeight = 128;
+const int softOcclusionBandHeight = 16;
+const int softOcclusionSubpixelBits = 4;
+
+// Gives the matrices an occluder is drawn with this frame
+typedef void (*OccluderFunction)(void *object, std::vector<glm::mat4> &models);
+
+struct SoftOccluder {
+    std::vector<glm::vec3> triangles;   // Model space
+    void *object;
+    OccluderFunction matrices;
+    bool used;
+};
+
+// Triangle once projected, x and y in subpixels
+struct SoftTriangle {
+    int x[3];
+    int y[3];
+    float z[3];
+    int minY;                           // Rows it may cover
+    int maxY;
+};
+
+struct SoftOcclusion {
+
+    void init(ThreadPool *pool = NULL);
+    void cleanup();
+
+    int addOccluder(const std::vector<glm::vec3> &triangles, void *object, OccluderFunction matrices);
+    void removeOccluder(int occluder);
+
+    void render(const glm::mat4 &viewProjection);
+    bool isBoxOccluded(glm::vec3 min, glm::vec3 max) const;
+    bool isSphereOccluded(glm::vec3 center, float radius) const;
+
+    // Rasterizing
+    void projectTriangle(const glm::vec4 clip[3]);
+    void rasterizeBand(int band);
+    bool isRectOccluded(glm::vec2 min, glm::vec2 max, float nearestDepth) const;
+
+    ThreadPool *pool = NULL;
+    bool simd = true;                   // False keeps to the scalar loop, both fill the same buffer
+    std::vector<SoftOccluder> occluders;
+    std::vector<glm::mat4> models;      // Filled by the callbacks
+    std::vector<SoftTriangle> projected;
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<float> depth;           // Row major, bottom row first like GL
+    bool rendered = false;              // Nothing is occluded before the first render
+};
+
+#endif //SOFTOCCLUSION_H
@@ -0,0 +1,97 @@
+#include "streamBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+StreamBuffer frameStream;
+
+void StreamBuffer::init(GLsizeiptr regionSize, int regionCount)
+{
+	this->regionCount = std::min(std::max(regionCount, 1), maxStreamRegions);
+
+	// Offsets must suit glBindBufferRange on uniform buffers, 16 keeps mat4 copies aligned
+	GLint uniformAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	alignment = std::max(uniformAlignment, 16);
+
+	this->regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, this->regionSize * this->regionCount, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	frame = 0;
+	region = 0;
+	used = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+	region = frame % regionCount;
+	used = 0;
+
+	// The GPU must be done with what we wrote regionCount frames ago
+	GLsync &fence = fences[region];
+	if (fence != NULL)
+	{
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync(fence);
+		fence = NULL;
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame++;
+}
+
+bool StreamBuffer::write(const void *data, GLsizeiptr size, GLintptr &bufferOffset)
+{
+	GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+	if (buffer == 0 || start + size > regionSize)
+	{
+		return false;
+	}
+
+	bufferOffset = region * regionSize + start;
+
+	// Nobody reads this range anymore, the fence in beginFrame made sure of it
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	void *mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, bufferOffset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped == NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return false;
+	}
+	memcpy(mapped, data, size);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	used = start + size;
+	return true;
+}
+
+bool StreamBuffer::isCurrent(unsigned long writtenFrame) const
+{
+	// The region is rewritten regionCount frames later
+	return frame - writtenFrame < (unsigned long)regionCount;
+}
+
+void StreamBuffer::cleanup()
+{
+	for (int i = 0; i < maxStreamRegions; i++)
+	{
+		if (fences[i] != NULL)
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = NULL;
+		}
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
@@ -0,0 +1,53 @@
+#include <glad/gl.h>
+
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Ring buffer for the data we rewrite while the GPU may still //
+//  read the previous version (joint palettes, instance matrices).  //
+//  The buffer is split in one region per frame in flight, each     //
+//  region is fenced at the end of its frame and only reused once   //
+//  the fence passed, so writes map it UNSYNCHRONIZED and never     //
+//  wait on the driver.                                             //
+//																	//
+//      init : Allocates regionCount regions of regionSize bytes.   //
+//      beginFrame : Waits for the oldest region and makes it the   //
+//          current one, call before any write of the frame.        //
+//      endFrame : Fences the current region, call before swapping. //
+//      write : Copies data in the current region, gives back its   //
+//          offset in "buffer" (aligned for glBindBufferRange).     //
+//          False if the region is full, use a regular upload then. //
+//      isCurrent : Data written on that frame is still there.      //
+//      cleanup : Deletes the buffer and the pending fences.        //
+//																	//
+//------------------------------------------------------------------//
+
+const int maxStreamRegions = 4;
+
+struct StreamBuffer {
+
+    void init(GLsizeiptr regionSize, int regionCount = 3);
+    void beginFrame();
+    void endFrame();
+    bool write(const void *data, GLsizeiptr size, GLintptr &bufferOffset);
+    bool isCurrent(unsigned long writtenFrame) const;
+    void cleanup();
+
+    GLuint buffer = 0;
+    GLsizeiptr regionSize = 0;
+    int regionCount = 0;
+    GLint alignment = 16;
+
+    // Current region and how much of it is used
+    unsigned long frame = 0;
+    int region = 0;
+    GLsizeiptr used = 0;
+    GLsync fences[maxStreamRegions] = {};
+};
+
+// Per frame data of every object, owned by main
+extern StreamBuffer frameStream;
+
+#endif //STREAMBUFFER_H
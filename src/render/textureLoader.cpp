@@ -0,0 +1,226 @@
+#include "textureLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// Baked file identification, bump the version when the layout changes
+static const char bakedMagic[4] = {'B', 'T', 'E', 'X'};
+static const uint32_t bakedVersion = 1;
+static const uint32_t bakedAlignment = 16;
+
+std::string bakedTexturePath(const char *texturePath)
+{
+	std::string path(texturePath);
+	size_t dot = path.find_last_of('.');
+	if (dot != std::string::npos && path.find_first_of("/\\", dot) == std::string::npos) {
+		path.erase(dot);
+	}
+	return path + ".btex";
+}
+
+int levelSize(GLenum format, int width, int height)
+{
+	if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+		return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+	}
+	return width * height * 3;
+}
+
+//---- Baked files ----
+
+bool writeBakedTexture(const char *filename, GLenum format, const std::vector<std::vector<uint8_t> > &levels, int width, int height)
+{
+	std::vector<uint8_t> bytes;
+	uint32_t header[6] = {bakedVersion, format, (uint32_t)width, (uint32_t)height, (uint32_t)levels.size(), 0};
+	bytes.insert(bytes.end(), bakedMagic, bakedMagic + 4);
+	bytes.insert(bytes.end(), (uint8_t *)header, (uint8_t *)header + 5 * sizeof(uint32_t));
+
+	// Level table, the offsets are known once the table is written
+	size_t tableStart = bytes.size();
+	bytes.resize(tableStart + levels.size() * 4 * sizeof(uint32_t));
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		bytes.resize((bytes.size() + bakedAlignment - 1) / bakedAlignment * bakedAlignment, 0);
+
+		uint32_t entry[4] = {(uint32_t)std::max(1, width >> i), (uint32_t)std::max(1, height >> i),
+			(uint32_t)levels[i].size(), (uint32_t)bytes.size()};
+		memcpy(&bytes[tableStart + i * sizeof(entry)], entry, sizeof(entry));
+
+		bytes.insert(bytes.end(), levels[i].begin(), levels[i].end());
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Failed to write baked texture: " << filename << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+	return file.good();
+}
+
+bool loadBakedTexture(const char *filename, ImageData &image)
+{
+	MappedFile *file = new MappedFile();
+	if (!file->open(filename) || file->size < 24 || memcmp(file->data, bakedMagic, 4) != 0) {
+		delete file;
+		return false;
+	}
+
+	uint32_t header[5];
+	memcpy(header, file->data + 4, sizeof(header));
+	size_t tableSize = (size_t)header[4] * 4 * sizeof(uint32_t);
+	if (header[0] != bakedVersion || header[4] == 0 || tableSize > file->size - 24) {
+		std::cout << "Wrong baked texture version: " << filename << std::endl;
+		delete file;
+		return false;
+	}
+
+	image.format = header[1];
+	image.width = header[2];
+	image.height = header[3];
+	image.levels.resize(header[4]);
+
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		uint32_t entry[4];
+		memcpy(entry, file->data + 24 + i * sizeof(entry), sizeof(entry));
+
+		TextureLevel &level = image.levels[i];
+		level.width = entry[0];
+		level.height = entry[1];
+		level.size = entry[2];
+		level.data = file->data + entry[3];
+
+		if (entry[3] > file->size || entry[2] > file->size - entry[3]
+			|| (int)entry[2] != levelSize(image.format, level.width, level.height)) {
+			std::cout << "Corrupted baked texture: " << filename << std::endl;
+			image.levels.clear();
+			delete file;
+			return false;
+		}
+	}
+
+	image.file = file;
+	return true;
+}
+
+//---- BC1 ----
+
+static uint16_t packRGB565(const uint8_t *rgb)
+{
+	return (uint16_t)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+static void unpackRGB565(uint16_t color, uint8_t *rgb)
+{
+	uint8_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors of a block, the last one is black in the 3 colors mode
+static void blockPalette(uint16_t color0, uint16_t color1, uint8_t palette[4][3])
+{
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		if (color0 > color1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// Bounding box endpoints, inset a bit so the interpolated colors land closer to the pixels
+void encodeBC1(const uint8_t *rgb, int width, int height, std::vector<uint8_t> &blocks)
+{
+	blocks.resize(levelSize(GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height));
+	uint8_t *out = blocks.data();
+
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			// Gather the block, edges are clamped
+			uint8_t pixels[16][3];
+			uint8_t minColor[3] = {255, 255, 255}, maxColor[3] = {0, 0, 0};
+			for (int i = 0; i < 16; i++) {
+				int x = std::min(bx + i % 4, width - 1);
+				int y = std::min(by + i / 4, height - 1);
+				for (int c = 0; c < 3; c++) {
+					pixels[i][c] = rgb[(y * width + x) * 3 + c];
+					minColor[c] = std::min(minColor[c], pixels[i][c]);
+					maxColor[c] = std::max(maxColor[c], pixels[i][c]);
+				}
+			}
+			for (int c = 0; c < 3; c++) {
+				int inset = (maxColor[c] - minColor[c]) >> 4;
+				minColor[c] += inset;
+				maxColor[c] -= inset;
+			}
+
+			uint16_t color0 = packRGB565(maxColor);
+			uint16_t color1 = packRGB565(minColor);
+			uint32_t indices = 0;
+
+			// Equal endpoints would switch to the 3 colors mode, index 0 is fine for a flat block
+			if (color0 != color1) {
+				if (color0 < color1) {
+					std::swap(color0, color1);
+				}
+				uint8_t palette[4][3];
+				blockPalette(color0, color1, palette);
+
+				for (int i = 0; i < 16; i++) {
+					int best = 0, bestDistance = 1 << 30;
+					for (int p = 0; p < 4; p++) {
+						int distance = 0;
+						for (int c = 0; c < 3; c++) {
+							int d = pixels[i][c] - palette[p][c];
+							distance += d * d;
+						}
+						if (distance < bestDistance) {
+							bestDistance = distance;
+							best = p;
+						}
+					}
+					indices |= (uint32_t)best << (2 * i);
+				}
+			}
+
+			memcpy(out, &color0, 2);
+			memcpy(out + 2, &color1, 2);
+			memcpy(out + 4, &indices, 4);
+			out += 8;
+		}
+	}
+}
+
+void decodeBC1(const uint8_t *blocks, int width, int height, std::vector<uint8_t> &rgb)
+{
+	rgb.resize(width * height * 3);
+
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			uint16_t color0, color1;
+			uint32_t indices;
+			memcpy(&color0, blocks, 2);
+			memcpy(&color1, blocks + 2, 2);
+			memcpy(&indices, blocks + 4, 4);
+			blocks += 8;
+
+			uint8_t palette[4][3];
+			blockPalette(color0, color1, palette);
+
+			for (int i = 0; i < 16; i++) {
+				int x = bx + i % 4, y = by + i / 4;
+				if (x >= width || y >= height) {
+					continue;
+				}
+				memcpy(&rgb[(y * width + x) * 3], palette[(indices >> (2 * i)) & 3], 3);
+			}
+		}
+	}
+}
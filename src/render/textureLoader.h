@@ -0,0 +1,38 @@
+#include <glad/gl.h>
+
+#include <string>
+#include <vector>
+
+#include "helpers.h"
+#include <render/glExtensions.h>
+
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Baked textures (".btex"), made offline by the bakeTexture   //
+//  tool. They hold the whole mip chain, either as RGB or BC1       //
+//  (S3TC DXT1) blocks, so nothing is decoded nor generated at      //
+//  runtime. The file is mapped and the levels are uploaded         //
+//  straight from it.                                               //
+//																	//
+//      loadBakedTexture : Maps the file and fills image.levels     //
+//      writeBakedTexture : Used by the bake tool.                  //
+//      encodeBC1 / decodeBC1 : 4x4 block compression, decoding is  //
+//          only used when the driver has no S3TC support.          //
+//																	//
+//------------------------------------------------------------------//
+
+std::string bakedTexturePath(const char *texturePath);
+bool loadBakedTexture(const char *filename, ImageData &image);
+bool writeBakedTexture(const char *filename, GLenum format, const std::vector<std::vector<uint8_t> > &levels, int width, int height);
+
+// Sizes
+int levelSize(GLenum format, int width, int height);
+
+// BC1
+void encodeBC1(const uint8_t *rgb, int width, int height, std::vector<uint8_t> &blocks);
+void decodeBC1(const uint8_t *blocks, int width, int height, std::vector<uint8_t> &rgb);
+
+#endif //TEXTURELOADER_H
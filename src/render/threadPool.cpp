@@ -0,0 +1,76 @@
+#include "threadPool.h"
+
+#include <algorithm>
+
+void ThreadPool::init(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	stopping = false;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+void ThreadPool::submit(const std::function<void()> &task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push(task);
+		pending++;
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	tasksDone.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+			// Remaining tasks are still run before stopping
+			if (tasks.empty())
+			{
+				return;
+			}
+			task = tasks.front();
+			tasks.pop();
+		}
+
+		task();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending--;
+		}
+		tasksDone.notify_all();
+	}
+}
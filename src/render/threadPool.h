@@ -0,0 +1,44 @@
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+//------------------------------------------------------------------//
+//																	//
+//		Small worker pool used for the CPU side of asset loading    //
+//  (file reading, parsing, image decoding). Tasks must never call  //
+//  OpenGL, the context only lives on the render thread.            //
+//																	//
+//      init : Starts the workers, defaults to one per core         //
+//      submit : Queues a task                                      //
+//      wait : Blocks until every queued task is done               //
+//      cleanup : Stops and joins the workers                       //
+//																	//
+//------------------------------------------------------------------//
+
+struct ThreadPool {
+
+    void init(unsigned int threadCount = 0);
+    void submit(const std::function<void()> &task);
+    void wait();
+    void cleanup();
+
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    // Synchronisation
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksDone;
+    unsigned int pending = 0;       // Queued or running tasks
+    bool stopping = false;
+};
+
+#endif //THREADPOOL_H
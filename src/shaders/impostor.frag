@@ -0,0 +1,18 @@
+#version 330 core
+
+// Impostor quads, the atlas color is premultiplied by the coverage held in its alpha (see Impostor::writeCoverage)
+
+in vec2 atlasUV;
+
+out vec3 finalColor;
+
+uniform sampler2D colorAtlas;
+
+void main()
+{
+	vec4 texel = texture(colorAtlas, atlasUV);
+	if (texel.a < 0.5) {
+		discard;
+	}
+	finalColor = texel.rgb / texel.a;
+}
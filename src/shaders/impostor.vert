@@ -0,0 +1,39 @@
+#version 330 core
+
+// Camera facing quads of an Impostor (see impostor.h), the view layout is the one of the atlas
+const int azimuths = 8;
+const int elevations = 3;
+const float elevationStep = 0.785398;     // 45 degrees
+const float azimuthStep = 6.283185 / float(azimuths);
+
+// Input
+layout(location = 0) in vec2 corner;
+layout(location = 5) in mat4 i_modelMat;
+
+// Output data
+out vec2 atlasUV;
+
+uniform mat4 VP;
+uniform vec3 viewer;
+uniform vec4 bounds;        // Model space center and radius
+
+void main() {
+    vec3 center = (i_modelMat * vec4(bounds.xyz, 1.0)).xyz;
+    float scale = max(length(i_modelMat[0].xyz), max(length(i_modelMat[1].xyz), length(i_modelMat[2].xyz)));
+    vec3 toViewer = viewer - center;
+
+    // The view baked closest to the direction the instance is seen from, in model space
+    vec3 local = normalize(inverse(mat3(i_modelMat)) * toViewer);
+    float azimuth = mod(floor(atan(local.z, local.x) / azimuthStep + 0.5), float(azimuths));
+    float elevation = clamp(floor(asin(clamp(local.y, -1.0, 1.0)) / elevationStep + 0.5) + float((elevations - 1) / 2), 0.0, float(elevations - 1));
+
+    // Turned around the model up axis like the baking camera, the model x axis when seen from straight above
+    vec3 up = normalize(i_modelMat[1].xyz);
+    vec3 forward = -normalize(toViewer);
+    vec3 right = cross(forward, up);
+    right = (dot(right, right) > 1e-6) ? normalize(right) : normalize(i_modelMat[0].xyz);
+    vec3 billboardUp = cross(right, forward);
+
+    gl_Position = VP * vec4(center + (right * corner.x + billboardUp * corner.y) * bounds.w * scale, 1.0);
+    atlasUV = (vec2(azimuth, elevation) + corner * 0.5 + 0.5) / vec2(azimuths, elevations);
+}
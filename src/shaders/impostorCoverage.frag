@@ -0,0 +1,14 @@
+#version 330 core
+
+// Only the alpha of the atlas is written, 1 where the bake left a depth
+
+in vec2 atlasUV;
+
+out vec4 coverage;
+
+uniform sampler2D depthAtlas;
+
+void main()
+{
+	coverage = vec4(0.0, 0.0, 0.0, (texture(depthAtlas, atlasUV).r < 1.0) ? 1.0 : 0.0);
+}
@@ -1,37 +1,54 @@
 #version 330 core
 
+// Uber shader for gltfObj, see obj.vert for the features
+
+#ifdef DEPTH
+
+void main() {}
+
+#else
+
 out vec3 finalColor;
 
 in vec3 worldPosition;
 in vec3 worldNormal;	// normalised in vertex shader
+in vec2 textureUV;
+#ifdef BATCHED
+flat in vec4 drawColor;
+#endif
 
+#ifdef LIGHTING
+// Light information
 uniform vec3 lightPosition;
 uniform vec3 lightIntensity;
+#endif
 
-// Color related
+// Managing the color information
 uniform vec4  baseColorFactor;
 uniform float metallicFactor;
 uniform float roughnessFactor;
 
-// Texture related
-in vec2 textureUV;
+#ifdef TEXTURE
 uniform sampler2D textureSampler;
-uniform float validTexture;			// If valid texture is 0.0f, there is no texture, if not there is one
+#endif
 
+#ifdef SHADOWS
 // Shadow related
 in vec4 projectedPosition;
 uniform sampler2D depthTextureSampler;
-
+#endif
 
 void main()
 {
-	vec3 color;
-	if (validTexture == 1.0f){
-		color = texture(textureSampler,textureUV).rgb;
-	}else{
-		color = vec3(baseColorFactor[0], baseColorFactor[1], baseColorFactor[2]); 		// Color (calculated from RGBa)
-	}
-
+#ifdef TEXTURE
+	vec3 color = texture(textureSampler,textureUV).rgb;
+#elif defined(BATCHED)
+	vec3 color = drawColor.rgb;					// Material of the draw, from the batch colors
+#else
+	vec3 color = baseColorFactor.rgb;			// Color (calculated from RGBa)
+#endif
+
+#ifdef LIGHTING
 	// Lighting
 	vec3  lightDir  = lightPosition - worldPosition;
 	float lightDist = dot(lightDir, lightDir);
@@ -46,7 +63,11 @@ void main()
 
 	// Gamma correction
 	v = pow(v, vec3(1.0 / 2.2));
+#else
+	vec3 v = color;
+#endif
 
+#ifdef SHADOWS
 	// Shadow calulations
 	float shadow = 1.0f;
 	if ((abs(projectedPosition.x) < projectedPosition.w) && (abs(projectedPosition.y) < projectedPosition.w)) {
@@ -61,8 +82,10 @@ void main()
 		float existingDepth = texture(depthTextureSampler, uv.xy).r;
 		shadow = (depth >= existingDepth + 7e-3) ? 0.2 : 1.0;
 	}
+	v *= shadow;
+#endif
 
-
-	// Gamma correction
-	finalColor = v * shadow;
+	finalColor = v;
 }
+
+#endif
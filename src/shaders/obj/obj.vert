@@ -1,36 +1,66 @@
 #version 330 core
 
+// Uber shader for gltfObj, the features are #defines added by the shaderManager :
+// SHADOWS, INSTANCING, SKINNING, TEXTURE, LIGHTING, DEPTH (depth only, no outputs),
+// BATCHED (static batch, the vertices are already skinned and drawn instanced, see staticBatch)
+
+// Same transform in every variant so the depth pass matches the color pass exactly
+invariant gl_Position;
+
 // Input
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 vertexUV;
 
+#ifdef BATCHED
+// Index in the batch colors
+layout(location = 3) in float drawIndex;
+#else
 // Joint matrices IDs and weight
 layout(location = 3) in vec4 j_IDs;
 layout(location = 4) in vec4 j_weights;
+#endif
 
+#ifdef INSTANCING
 // Model matrice because of instancing
 layout(location = 5) in mat4 i_modelMat;
+#endif
 
+#ifndef DEPTH
 // Output data, to be interpolated for each fragment
 out vec3 worldPosition;
 out vec3 worldNormal;
 out vec2 textureUV;
+#ifdef BATCHED
+flat out vec4 drawColor;
+#endif
+#ifdef SHADOWS
 out vec4 projectedPosition;
+#endif
+#endif
 
 // View matrices
 uniform mat4 MVP;
+#if defined(SHADOWS) && !defined(DEPTH)
 uniform mat4 LVP;
+#endif
 
+#ifdef SKINNING
 // vector containing all of the joint matrices
 layout(std140) uniform jointMatrices {
     mat4 jointMatricesVec[25];
 };
+#endif
 
-void main() {
-    // Textures
-    textureUV = vertexUV;
+#if defined(BATCHED) && !defined(DEPTH)
+// Base color of every draw of the batch
+layout(std140) uniform batchColors {
+    vec4 drawColors[256];
+};
+#endif
 
+void main() {
+#ifdef SKINNING
     // normalising the weights in case
     float total_weight = j_weights.x + j_weights.y + j_weights.z + j_weights.w;
     vec4 normweights = vec4(j_weights/total_weight);
@@ -41,14 +71,39 @@ void main() {
     + jointMatricesVec[int(j_IDs.y)]* normweights.y
     + jointMatricesVec[int(j_IDs.z)]* normweights.z
     + jointMatricesVec[int(j_IDs.w)]* normweights.w;
+#else
+    mat4 skinMat = mat4(1.0);
+#endif
 
-    mat4 skinMatNormal = transpose(inverse(skinMat));
+#ifdef INSTANCING
+    mat4 modelMat = i_modelMat;
+#else
+    mat4 modelMat = mat4(1.0);      // Already in MVP
+#endif
+
+#ifndef DEPTH
+    // Textures
+    textureUV = vertexUV;
 
     // World-space geometry
+#ifdef BATCHED
+    worldPosition = vertexPosition;     // Already skinned
+    drawColor = drawColors[int(drawIndex)];
+#else
     worldPosition = (skinMat * vec4(vertexPosition,1)).xyz;
+#endif
+#ifdef SKINNING
+    mat4 skinMatNormal = transpose(inverse(skinMat));
     worldNormal = normalize((skinMatNormal * vec4(vertexNormal, 0.0)).xyz);
+#else
+    worldNormal = normalize(vertexNormal);
+#endif
+
+#ifdef SHADOWS
+    projectedPosition = LVP * modelMat * skinMat * vec4(vertexPosition,1.0f);
+#endif
+#endif
 
     // Transform vertex
-    gl_Position =  MVP * i_modelMat * skinMat * vec4(vertexPosition,1);
-    projectedPosition = LVP * i_modelMat * skinMat * vec4(vertexPosition,1.0f);
-}
\ No newline at end of file
+    gl_Position =  MVP * modelMat * skinMat * vec4(vertexPosition,1);
+}
@@ -1,3 +0,0 @@
-#version 330 core
-
-void main() {}
@@ -0,0 +1,5 @@
+#version 330 core
+
+// Nothing is written, only the samples passing the depth test are counted
+
+void main() {}
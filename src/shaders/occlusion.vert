@@ -0,0 +1,11 @@
+#version 330 core
+
+// Boxes of the occlusion queries, the unit cube scaled and placed by MVP
+
+layout(location = 0) in vec3 vertexPosition;
+
+uniform mat4 MVP;
+
+void main() {
+    gl_Position = MVP * vec4(vertexPosition, 1);
+}
@@ -0,0 +1,190 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "render/softOcclusion.h"
+#include "render/threadPool.h"
+
+//------------------------------------------------------------------//
+//																	//
+//		Checks of the SoftOcclusion rasterizer, it needs no GL      //
+//  context so it runs on its own through ctest. Each check prints  //
+//  what failed, the exit code is the number of failures.           //
+//																	//
+//      usage : softOcclusionTest                                   //
+//																	//
+//------------------------------------------------------------------//
+
+// Occluders are given in world space, drawn once
+static void identityMatrices(void *, std::vector<glm::mat4> &models)
+{
+	models.push_back(glm::mat4(1.0f));
+}
+
+static int failures = 0;
+
+static void check(bool passed, const char *what)
+{
+	if (!passed)
+	{
+		std::cout << "FAILED : " << what << std::endl;
+		failures++;
+	}
+}
+
+static glm::mat4 cameraMatrix()
+{
+	return glm::perspective(glm::radians(45.0f), (float)softOcclusionWidth / softOcclusionHeight, 0.1f, 100.0f);
+}
+
+// Two triangles far past the screen edges at z = -5, sharing their diagonal
+static std::vector<glm::vec3> wallTriangles()
+{
+	glm::vec3 corners[4] = {glm::vec3(-20.0f, -20.0f, -5.0f), glm::vec3(20.0f, -20.0f, -5.0f),
+							glm::vec3(20.0f, 20.0f, -5.0f), glm::vec3(-20.0f, 20.0f, -5.0f)};
+	std::vector<glm::vec3> triangles = {corners[0], corners[1], corners[2], corners[0], corners[2], corners[3]};
+	return triangles;
+}
+
+// A fan of thin triangles around the centre of the screen, every edge but the outer ones is shared
+static std::vector<glm::vec3> fanTriangles(int slices)
+{
+	std::vector<glm::vec3> triangles;
+	glm::vec3 centre(0.3f, -0.2f, -5.0f);
+	for (int s = 0; s < slices; s++)
+	{
+		float from = 6.2831853f * s / slices;
+		float to = 6.2831853f * (s + 1) / slices;
+		triangles.push_back(centre);
+		triangles.push_back(centre + glm::vec3(30.0f * std::cos(from), 30.0f * std::sin(from), 0.0f));
+		triangles.push_back(centre + glm::vec3(30.0f * std::cos(to), 30.0f * std::sin(to), 0.0f));
+	}
+	return triangles;
+}
+
+// Same seed every run, triangles of any size and winding in front of the camera
+static std::vector<glm::vec3> randomTriangles(int count)
+{
+	unsigned int seed = 12345;
+	std::vector<glm::vec3> triangles;
+	for (int i = 0; i < count * 3; i++)
+	{
+		glm::vec3 vertex;
+		for (int c = 0; c < 3; c++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			vertex[c] = (seed >> 8) / 16777216.0f;
+		}
+		triangles.push_back(glm::vec3(vertex.x * 16.0f - 8.0f, vertex.y * 8.0f - 4.0f, -1.0f - vertex.z * 30.0f));
+	}
+	return triangles;
+}
+
+static int uncoveredPixels(const SoftOcclusion &occlusion)
+{
+	int uncovered = 0;
+	for (size_t i = 0; i < occlusion.depth.size(); i++)
+	{
+		if (occlusion.depth[i] >= 1.0f)
+		{
+			uncovered++;
+		}
+	}
+	return uncovered;
+}
+
+static void testWall(ThreadPool *pool, bool simd)
+{
+	SoftOcclusion occlusion;
+	occlusion.init(pool);
+	occlusion.simd = simd;
+	occlusion.addOccluder(wallTriangles(), NULL, identityMatrices);
+	occlusion.render(cameraMatrix());
+
+	check(uncoveredPixels(occlusion) == 0, "the wall covers every pixel");
+	check(occlusion.isSphereOccluded(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "a sphere behind the wall is occluded");
+	check(occlusion.isBoxOccluded(glm::vec3(-1.0f, -1.0f, -30.0f), glm::vec3(1.0f, 1.0f, -10.0f)), "a box behind the wall is occluded");
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, 0.0f, -2.0f), 0.5f), "a sphere in front of the wall is not occluded");
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, 0.0f, -5.0f), 1.0f), "a sphere through the wall is not occluded");
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f), "a sphere around the eye is not occluded");
+	check(!occlusion.isBoxOccluded(glm::vec3(-1.0f, -1.0f, -20.0f), glm::vec3(1.0f, 1.0f, -0.05f)), "a box crossing the near plane is not occluded");
+	check(!occlusion.isBoxOccluded(glm::vec3(-1.0f, -1.0f, 1.0f), glm::vec3(1.0f, 1.0f, 2.0f)), "a box behind the eye is not occluded");
+	occlusion.cleanup();
+}
+
+static void testFan()
+{
+	SoftOcclusion occlusion;
+	occlusion.init();
+	occlusion.addOccluder(fanTriangles(97), NULL, identityMatrices);
+	occlusion.render(cameraMatrix());
+	check(uncoveredPixels(occlusion) == 0, "the fan leaves no gap along its shared edges");
+	occlusion.cleanup();
+}
+
+// The occluder crosses the near plane, what is in front of the eye still hides what is behind it
+static void testNearClipping()
+{
+	std::vector<glm::vec3> floor = {glm::vec3(-50.0f, -1.0f, 10.0f), glm::vec3(50.0f, -1.0f, 10.0f), glm::vec3(0.0f, -1.0f, -90.0f)};
+	SoftOcclusion occlusion;
+	occlusion.init();
+	occlusion.addOccluder(floor, NULL, identityMatrices);
+	occlusion.render(cameraMatrix());
+	check(occlusion.isSphereOccluded(glm::vec3(0.0f, -3.0f, -10.0f), 0.5f), "a sphere under a clipped floor is occluded");
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, 1.0f, -10.0f), 0.5f), "a sphere over a clipped floor is not occluded");
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, -3.0f, 0.0f), 0.5f), "a sphere under the eye plane is not occluded");
+	occlusion.cleanup();
+}
+
+// Nothing is occluded before the first render
+static void testNotRendered()
+{
+	SoftOcclusion occlusion;
+	occlusion.init();
+	occlusion.addOccluder(wallTriangles(), NULL, identityMatrices);
+	check(!occlusion.isSphereOccluded(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "nothing is occluded before render");
+	occlusion.cleanup();
+}
+
+static void testSimdMatchesScalar(ThreadPool *pool)
+{
+	std::vector<glm::vec3> triangles = randomTriangles(400);
+
+	SoftOcclusion simd, scalar;
+	simd.init(pool);
+	scalar.init();
+	scalar.simd = false;
+	simd.addOccluder(triangles, NULL, identityMatrices);
+	scalar.addOccluder(triangles, NULL, identityMatrices);
+	simd.render(cameraMatrix());
+	scalar.render(cameraMatrix());
+
+	check(simd.depth == scalar.depth, "the SSE and scalar loops fill the same buffer");
+	check(uncoveredPixels(scalar) < (int)scalar.depth.size(), "the random triangles cover something");
+	simd.cleanup();
+	scalar.cleanup();
+}
+
+int main()
+{
+	ThreadPool pool;
+	pool.init(4);
+
+	testWall(NULL, true);
+	testWall(NULL, false);
+	testWall(&pool, true);
+	testFan();
+	testNearClipping();
+	testNotRendered();
+	testSimdMatchesScalar(&pool);
+
+	pool.cleanup();
+	if (failures == 0)
+	{
+		std::cout << "All SoftOcclusion checks passed" << std::endl;
+	}
+	return failures;
+}
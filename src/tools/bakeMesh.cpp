@@ -0,0 +1,67 @@
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <cstring>
+#include <iostream>
+
+#include "objects/obj/modelLoader.h"
+
+//------------------------------------------------------------------//
+//																	//
+//		Offline bake step, turns every GLTF or GLB file given on    //
+//  the command line into a ".bmesh" file next to it. The main      //
+//  program picks the baked file up as long as it is newer than     //
+//  the source. Meshes go through the meshOptimizer unless          //
+//  "--no-optimize" is given first.                                 //
+//																	//
+//      usage : bakeMesh [--no-optimize] model.gltf [model2 ...]    //
+//																	//
+//------------------------------------------------------------------//
+
+int main(int argc, char **argv)
+{
+	bool optimize = true;
+	int first = 1;
+	if (argc > 1 && strcmp(argv[1], "--no-optimize") == 0) {
+		optimize = false;
+		first = 2;
+	}
+
+	if (first >= argc)
+	{
+		std::cout << "usage : " << argv[0] << " [--no-optimize] model.gltf [model2.gltf ...]" << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+	for (int i = first; i < argc; i++)
+	{
+		ModelData data;
+		if (!loadGLTFModel(argv[i], data, optimize))
+		{
+			failures++;
+			continue;
+		}
+
+		std::string bakedPath = bakedModelPath(argv[i]);
+		if (!writeBakedModel(bakedPath.c_str(), data))
+		{
+			failures++;
+			continue;
+		}
+
+		// Read it back so a broken bake fails here instead of at launch
+		ModelData check;
+		if (!loadBakedModel(bakedPath.c_str(), check))
+		{
+			failures++;
+			continue;
+		}
+		std::cout << "Baked " << argv[i] << " -> " << bakedPath << std::endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <tinygltf-2.9.3/stb_image.h>
+
+#include <cstring>
+#include <iostream>
+
+#include <render/textureLoader.h>
+
+//------------------------------------------------------------------//
+//																	//
+//		Offline bake step for textures, turns every image given on  //
+//  the command line into a ".btex" file next to it, holding the    //
+//  whole mip chain. Levels are BC1 compressed unless "--rgb" is    //
+//  given first. The main program picks the baked file up as long   //
+//  as it is newer than the image.                                  //
+//																	//
+//      usage : bakeTexture [--rgb] image.png [image2.png ...]      //
+//																	//
+//------------------------------------------------------------------//
+
+// Box filter, odd sizes reuse their last row or column
+static void downsample(const std::vector<uint8_t> &source, int width, int height, std::vector<uint8_t> &target)
+{
+	int targetWidth = std::max(1, width / 2);
+	int targetHeight = std::max(1, height / 2);
+	target.resize(targetWidth * targetHeight * 3);
+
+	for (int y = 0; y < targetHeight; y++) {
+		for (int x = 0; x < targetWidth; x++) {
+			int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+			int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+			for (int c = 0; c < 3; c++) {
+				int sum = source[(y0 * width + x0) * 3 + c] + source[(y0 * width + x1) * 3 + c]
+					+ source[(y1 * width + x0) * 3 + c] + source[(y1 * width + x1) * 3 + c];
+				target[(y * targetWidth + x) * 3 + c] = (sum + 2) / 4;
+			}
+		}
+	}
+}
+
+static bool bakeTexture(const char *texturePath, GLenum format)
+{
+	int width, height, channels;
+	uint8_t *pixels = stbi_load(texturePath, &width, &height, &channels, 3);
+	if (pixels == NULL) {
+		std::cout << "Failed to load texture " << texturePath << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> level(pixels, pixels + width * height * 3);
+	stbi_image_free(pixels);
+
+	// Every level down to 1x1
+	std::vector<std::vector<uint8_t> > levels;
+	int levelWidth = width, levelHeight = height;
+	while (true) {
+		if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+			levels.push_back(std::vector<uint8_t>());
+			encodeBC1(level.data(), levelWidth, levelHeight, levels.back());
+		} else {
+			levels.push_back(level);
+		}
+
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		std::vector<uint8_t> next;
+		downsample(level, levelWidth, levelHeight, next);
+		level.swap(next);
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+
+	std::string bakedPath = bakedTexturePath(texturePath);
+	if (!writeBakedTexture(bakedPath.c_str(), format, levels, width, height)) {
+		return false;
+	}
+
+	// Read it back so a broken bake fails here instead of at launch
+	ImageData check;
+	if (!loadBakedTexture(bakedPath.c_str(), check)) {
+		return false;
+	}
+	check.levels.clear();
+	delete check.file;
+
+	std::cout << "Baked " << texturePath << " -> " << bakedPath << " (" << levels.size() << " levels)" << std::endl;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	GLenum format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	int first = 1;
+	if (argc > 1 && strcmp(argv[1], "--rgb") == 0) {
+		format = GL_RGB;
+		first = 2;
+	}
+
+	if (first >= argc)
+	{
+		std::cout << "usage : " << argv[0] << " [--rgb] image.png [image2.png ...]" << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+	for (int i = first; i < argc; i++)
+	{
+		if (!bakeTexture(argv[i], format))
+		{
+			failures++;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}